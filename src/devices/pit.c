@@ -11,8 +11,7 @@
 #define PIT_PORT_CONTROL 0x43                        /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL)) /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
+static void load_channel(int channel, int mode, unsigned count);
 
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
@@ -41,7 +40,8 @@
 
      - Other modes are less useful.
 
-   FREQUENCY is the number of periods per second, in Hz. */
+   FREQUENCY is the number of periods per second, in Hz.  See
+   pit_configure_oneshot() for a single, exact delay. */
 void pit_configure_channel(int channel, int mode, int frequency) {
   uint16_t count;
   enum intr_level old_level;
@@ -70,8 +70,54 @@ void pit_configure_channel(int channel, int mode, int frequency) {
 
   /* Configure the PIT mode and load its counters. */
   old_level = intr_disable();
+  load_channel(channel, mode, count);
+  intr_set_level(old_level);
+}
+
+/* Configures CHANNEL in mode 0, a one-shot: the channel's output
+   drops to 0 now and rises to 1 after COUNT PIT cycles, staying
+   there until the channel is next configured.  On channel 0 the
+   rising edge raises one timer interrupt.  COUNT must be between
+   1 and 65536.
+
+   Reconfiguring a channel whose output is 0 into mode 2 or 3
+   raises its output at once, which on channel 0 looks like a
+   timer interrupt.  Reconfiguring it into mode 0 does not. */
+void pit_configure_oneshot(int channel, unsigned count) {
+  enum intr_level old_level;
+
+  ASSERT(channel == 0 || channel == 2);
+  ASSERT(count >= 1 && count <= 65536);
+
+  old_level = intr_disable();
+  load_channel(channel, 0, count);
+  intr_set_level(old_level);
+}
+
+/* Returns the number of PIT cycles left in CHANNEL's count and
+   stores the level of its output in *OUTPUT, using the 8254's
+   read-back command to latch both at the same instant. */
+unsigned pit_read_count(int channel, bool* output) {
+  enum intr_level old_level;
+  uint8_t status, lo, hi;
+
+  ASSERT(channel == 0 || channel == 2);
+
+  old_level = intr_disable();
+  outb(PIT_PORT_CONTROL, 0xc0 | (2 << channel));
+  status = inb(PIT_PORT_COUNTER(channel));
+  lo = inb(PIT_PORT_COUNTER(channel));
+  hi = inb(PIT_PORT_COUNTER(channel));
+  intr_set_level(old_level);
+
+  *output = (status & 0x80) != 0;
+  return (lo | hi << 8) != 0 ? (unsigned)(lo | hi << 8) : 65536;
+}
+
+/* Sets CHANNEL to MODE and loads COUNT into it, where a COUNT of
+   65536 is loaded as 0.  Interrupts must be off. */
+static void load_channel(int channel, int mode, unsigned count) {
   outb(PIT_PORT_CONTROL, (channel << 6) | 0x30 | (mode << 1));
   outb(PIT_PORT_COUNTER(channel), count);
   outb(PIT_PORT_COUNTER(channel), count >> 8);
-  intr_set_level(old_level);
 }
@@ -1,12 +1,15 @@
 #include "devices/serial.h"
 #include <debug.h>
+#include <stdio.h>
+#include <string.h>
 #include "devices/input.h"
-#include "devices/intq.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* Register definitions for the 16550A UART used in PCs.
    The 16550A has a lot more going on than shown here, but this
@@ -37,6 +40,17 @@
 #define IER_RECV 0x01 /* Interrupt when data received. */
 #define IER_XMIT 0x02 /* Interrupt when transmit finishes. */
 
+/* Interrupt Identification Register bits. */
+#define IIR_FIFO 0xc0 /* Both bits set if the FIFOs are enabled. */
+
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01   /* Enable the receive and transmit FIFOs. */
+#define FCR_CLEAR_RX 0x02 /* Discard the receive FIFO's contents. */
+#define FCR_CLEAR_TX 0x04 /* Discard the transmit FIFO's contents. */
+
+/* Depth of the 16550A's transmit FIFO, in bytes. */
+#define TX_FIFO_SIZE 16
+
 /* Line Control Register bits. */
 #define LCR_N81 0x03  /* No parity, 8 data bits, 1 stop bit. */
 #define LCR_DLAB 0x80 /* Divisor Latch Access Bit (DLAB). */
@@ -51,11 +65,43 @@
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
-static struct intq txq;
+/* Data to be transmitted.
+
+   This is a ring buffer of TXQ_SIZE bytes, allocated when the
+   port switches to queued mode.  Writers append to it in bulk
+   with interrupts off, and serial_interrupt() drains it into the
+   UART's transmit FIFO.  A writer that finds the queue full
+   sleeps until the interrupt handler has emptied half of it, so
+   heavy console output costs one wakeup per half queue instead
+   of a busy-wait per byte. */
+static uint8_t* txq;
+static size_t txq_size; /* Capacity, in bytes. */
+static size_t txq_head; /* New data is written here. */
+static size_t txq_cnt;  /* Number of bytes queued. */
+
+/* Thread waiting for room in the queue, if any.  txq_lock
+   ensures that only one thread waits at once. */
+static struct thread* txq_waiter;
+static struct lock txq_lock;
+
+/* Number of bytes the UART accepts at once when its transmit
+   holding register is empty: TX_FIFO_SIZE if it has a working
+   FIFO, otherwise 1. */
+static size_t tx_burst = 1;
+
+/* Statistics. */
+static long long queued_cnt;    /* Bytes added to the queue. */
+static long long polled_cnt;    /* Bytes sent by busy-waiting on the UART. */
+static long long wait_cnt;      /* Times a thread slept for room in the queue. */
+static long long xmit_intr_cnt; /* Transmit interrupts that sent data. */
+static size_t txq_max;          /* Most bytes ever queued at once. */
 
 static void set_serial(int bps);
 static void putc_poll(uint8_t);
+static void queue_bytes(const uint8_t*, size_t, enum intr_level);
+static void wait_for_room(void);
+static uint8_t dequeue_byte(void);
+static void fill_fifo(void);
 static void write_ier(void);
 static intr_handler_func serial_interrupt;
 
@@ -69,19 +115,32 @@ static void init_poll(void) {
   outb(FCR_REG, 0);        /* Disable FIFO. */
   set_serial(9600);        /* 9.6 kbps, N-8-1. */
   outb(MCR_REG, MCR_OUT2); /* Required to enable interrupts. */
-  intq_init(&txq);
   mode = POLL;
 }
 
 /* Initializes the serial port device for queued interrupt-driven
-   I/O.  With interrupt-driven I/O we don't waste CPU time
-   waiting for the serial device to become ready. */
-void serial_init_queue(void) {
+   I/O, with a transmit queue of TXQ_PAGES pages.  With
+   interrupt-driven I/O we don't waste CPU time waiting for the
+   serial device to become ready. */
+void serial_init_queue(size_t txq_pages) {
   enum intr_level old_level;
 
   if (mode == UNINIT)
     init_poll();
   ASSERT(mode == POLL);
+  ASSERT(txq_pages > 0);
+
+  txq = palloc_get_multiple(PAL_ASSERT, txq_pages);
+  txq_size = txq_pages * PGSIZE;
+  lock_init(&txq_lock);
+
+  /* Turn on the FIFOs.  Only a 16550A reports them as enabled
+     afterward; older UARTs have at most a one-byte buffer. */
+  outb(FCR_REG, FCR_ENABLE | FCR_CLEAR_RX | FCR_CLEAR_TX);
+  if ((inb(IIR_REG) & IIR_FIFO) == IIR_FIFO)
+    tx_burst = TX_FIFO_SIZE;
+  else
+    outb(FCR_REG, 0);
 
   intr_register_ext(0x20 + 4, serial_interrupt, "serial");
   mode = QUEUE;
@@ -92,27 +151,28 @@ void serial_init_queue(void) {
 
 /* Sends BYTE to the serial port. */
 void serial_putc(uint8_t byte) {
+  serial_putbuf((const char*)&byte, 1);
+}
+
+/* Sends the N bytes in BUFFER to the serial port.  Interrupts
+   are disabled and the interrupt enable register is updated
+   once for the whole buffer, rather than once per byte.  The
+   bytes are queued and serial_interrupt() sends them as the
+   UART drains. */
+void serial_putbuf(const char* buffer, size_t n) {
   enum intr_level old_level = intr_disable();
 
   if (mode != QUEUE) {
     /* If we're not set up for interrupt-driven I/O yet,
-         use dumb polling to transmit a byte. */
+       use dumb polling to transmit. */
     if (mode == UNINIT)
       init_poll();
-    putc_poll(byte);
+    while (n-- > 0)
+      putc_poll(*buffer++);
   } else {
-    /* Otherwise, queue a byte and update the interrupt enable
-         register. */
-    if (old_level == INTR_OFF && intq_full(&txq)) {
-      /* Interrupts are off and the transmit queue is full.
-             If we wanted to wait for the queue to empty,
-             we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-      putc_poll(intq_getc(&txq));
-    }
-
-    intq_putc(&txq, byte);
+    /* Otherwise, queue the bytes and update the interrupt
+       enable register. */
+    queue_bytes((const uint8_t*)buffer, n, old_level);
     write_ier();
   }
 
@@ -123,8 +183,8 @@ void serial_putc(uint8_t byte) {
    mode. */
 void serial_flush(void) {
   enum intr_level old_level = intr_disable();
-  while (!intq_empty(&txq))
-    putc_poll(intq_getc(&txq));
+  while (txq_cnt > 0)
+    putc_poll(dequeue_byte());
   intr_set_level(old_level);
 }
 
@@ -138,6 +198,13 @@ void serial_notify(void) {
     write_ier();
 }
 
+/* Prints serial port statistics. */
+void serial_print_stats(void) {
+  printf("Serial: %lld bytes queued (at most %zu of %zu at once), %lld polled, "
+         "%lld waits, %lld transmit interrupts\n",
+         queued_cnt, txq_max, txq_size, polled_cnt, wait_cnt, xmit_intr_cnt);
+}
+
 /* Configures the serial port for BPS bits per second. */
 static void set_serial(int bps) {
   int base_rate = 1843200 / 16;       /* Base rate of 16550A, in Hz. */
@@ -156,6 +223,96 @@ static void set_serial(int bps) {
   outb(LCR_REG, LCR_N81);
 }
 
+/* Appends the N bytes in BUFFER to the transmit queue.  If the
+   queue fills up, waits for the interrupt handler to make room,
+   unless OLD_LEVEL says interrupts were off when we were called:
+   reenabling them to wait would be impolite, so in that case we
+   make room by polling out a FIFO's worth of bytes instead. */
+static void queue_bytes(const uint8_t* buffer, size_t n, enum intr_level old_level) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  queued_cnt += n;
+  while (n > 0) {
+    size_t room = txq_size - txq_cnt;
+    size_t chunk;
+
+    if (room == 0) {
+      if (old_level == INTR_OFF) {
+        size_t i;
+
+        while ((inb(LSR_REG) & LSR_THRE) == 0)
+          continue;
+        for (i = 0; i < tx_burst && txq_cnt > 0; i++)
+          outb(THR_REG, dequeue_byte());
+        polled_cnt += i;
+      } else
+        wait_for_room();
+      continue;
+    }
+
+    /* Copy as much as fits before the end of the ring. */
+    chunk = txq_size - txq_head;
+    if (chunk > room)
+      chunk = room;
+    if (chunk > n)
+      chunk = n;
+    memcpy(txq + txq_head, buffer, chunk);
+    txq_head = (txq_head + chunk) % txq_size;
+    txq_cnt += chunk;
+    buffer += chunk;
+    n -= chunk;
+
+    if (txq_cnt > txq_max)
+      txq_max = txq_cnt;
+  }
+}
+
+/* Sleeps until the interrupt handler has drained at least half
+   of the (full) transmit queue. */
+static void wait_for_room(void) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(!intr_context());
+
+  lock_acquire(&txq_lock);
+  while (txq_cnt == txq_size) {
+    wait_cnt++;
+    write_ier();
+    txq_waiter = thread_current();
+    thread_block();
+  }
+  lock_release(&txq_lock);
+}
+
+/* Removes and returns the oldest byte in the transmit queue,
+   which must not be empty. */
+static uint8_t dequeue_byte(void) {
+  size_t tail;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(txq_cnt > 0);
+
+  tail = (txq_head + txq_size - txq_cnt) % txq_size;
+  txq_cnt--;
+  return txq[tail];
+}
+
+/* Moves bytes from the transmit queue into the UART, which must
+   be ready to accept them, and wakes up a thread waiting for
+   room if enough has been made. */
+static void fill_fifo(void) {
+  size_t i;
+
+  for (i = 0; i < tx_burst && txq_cnt > 0; i++)
+    outb(THR_REG, dequeue_byte());
+  if (i > 0)
+    xmit_intr_cnt++;
+
+  if (txq_waiter != NULL && txq_cnt <= txq_size / 2) {
+    thread_unblock(txq_waiter);
+    txq_waiter = NULL;
+  }
+}
+
 /* Update interrupt enable register. */
 static void write_ier(void) {
   uint8_t ier = 0;
@@ -164,7 +321,7 @@ static void write_ier(void) {
 
   /* Enable transmit interrupt if we have any characters to
      transmit. */
-  if (!intq_empty(&txq))
+  if (txq_cnt > 0)
     ier |= IER_XMIT;
 
   /* Enable receive interrupt if we have room to store any
@@ -183,6 +340,7 @@ static void putc_poll(uint8_t byte) {
   while ((inb(LSR_REG) & LSR_THRE) == 0)
     continue;
   outb(THR_REG, byte);
+  polled_cnt++;
 }
 
 /* Serial interrupt handler. */
@@ -196,10 +354,11 @@ static void serial_interrupt(struct intr_frame* f UNUSED) {
   while (!input_full() && (inb(LSR_REG) & LSR_DR) != 0)
     input_putc(inb(RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty(&txq) && (inb(LSR_REG) & LSR_THRE) != 0)
-    outb(THR_REG, intq_getc(&txq));
+  /* If the hardware is ready to accept data for transmission,
+     refill its FIFO from the queue.  THRE means the whole FIFO
+     is empty, so a full burst fits. */
+  if (txq_cnt > 0 && (inb(LSR_REG) & LSR_THRE) != 0)
+    fill_fifo();
 
   /* Update interrupt enable register based on queue status. */
   write_ier();
@@ -5,6 +5,10 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/sched-trace.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
@@ -116,12 +120,17 @@ void shutdown_power_off(void) {
 static void print_stats(void) {
   timer_print_stats();
   thread_print_stats();
+  palloc_print_stats();
+  slab_print_stats();
+  lock_print_stats();
 #ifdef FILESYS
   block_print_stats();
 #endif
   console_print_stats();
+  serial_print_stats();
   kbd_print_stats();
 #ifdef USERPROG
   exception_print_stats();
 #endif
+  sched_trace_dump();
 }
@@ -17,14 +17,77 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
-/* Number of timer ticks since OS booted. */
+/* Number of timer ticks since OS booted.  Updated only by the
+   timer interrupt, under TICKS_SEQ, so that timer_ticks() can
+   read it without turning off interrupts. */
 static int64_t ticks;
+static struct seqlock ticks_seq;
+
+/* Pending timers, in a hierarchical timing wheel.
+
+   Level 0 has a slot for each of the next WHEEL_SLOTS ticks.
+   Each slot of level 1 covers WHEEL_SLOTS ticks, each slot of
+   level 2 covers WHEEL_SLOTS level-1 slots, and so on.  A timer
+   goes in the lowest level that reaches its expiry tick, so
+   adding one takes O(1) time, as does canceling one, which just
+   removes it from its slot's list.
+
+   On each tick, timer_interrupt() runs every timer in the level 0
+   slot for that tick.  When the ticks for a whole slot of a
+   higher level have passed, which is every WHEEL_SLOTS ticks for
+   level 1, it first "cascades" the next slot of that level: each
+   of its timers moves down to the level that now suits it.  A
+   timer thus moves at most WHEEL_LEVELS - 1 times before it
+   runs.  Timers beyond the reach of the top level wait in its
+   farthest slot and are reconsidered each time that slot
+   cascades.
+
+   Protected by disabling interrupts. */
+#define WHEEL_BITS 6                      /* Bits of tick number per level. */
+#define WHEEL_SLOTS (1 << WHEEL_BITS)     /* Slots per level. */
+#define WHEEL_LEVELS 4                    /* Number of levels. */
+static struct list wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+
+/* Tickless idle, enabled by the kernel command-line option
+   "-tickless".
+
+   When the idle thread is about to halt, timer_idle() stops the
+   periodic tick if no timer is due on the next tick.  It sets
+   the PIT to interrupt once, on the tick boundary on which a
+   timer is next due or as far ahead as its 16-bit counter
+   reaches (ONESHOT_MAX_TICKS), whichever is sooner.  Once the
+   CPU wakes, the ticks that went by without an interrupt are
+   replayed, each doing what a real tick would have done, so
+   that TICKS, timers, and thread_tick()'s accounting come out
+   as if the tick had never stopped.
+
+   If some other interrupt wakes the CPU first, timer_wake()
+   replays the ticks that have passed and shortens the one-shot
+   to end on the next tick boundary.  Switching straight back to
+   the periodic mode would raise the PIT's output while it is
+   low, which the PIC would take as an extra tick, so periodic
+   ticking always resumes from the one-shot's own interrupt.
+
+   Protected by disabling interrupts. */
+bool timer_tickless;
+#define TICK_COUNT ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ) /* PIT cycles per tick. */
+#define ONESHOT_MAX_TICKS (65536 / TICK_COUNT)            /* Longest one-shot, in ticks. */
+static int64_t oneshot_start;   /* TICKS when the one-shot was loaded. */
+static int64_t oneshot_end;     /* Tick the one-shot ends on, or 0 if ticking. */
+static unsigned oneshot_count;  /* PIT cycles loaded into the one-shot. */
+static unsigned oneshot_first;  /* PIT cycles from loading to the next tick. */
+static int64_t skipped_ticks;   /* Ticks replayed instead of interrupted for. */
 
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
 static intr_handler_func timer_interrupt;
+static void tick(void);
+static int ticks_until_due(int max);
+static void wheel_insert(struct timer*);
+static void wheel_cascade(int level);
+static void wake_thread(void* t);
 static bool too_many_loops(unsigned loops);
 static void busy_wait(int64_t loops);
 static void real_time_sleep(int64_t num, int32_t denom);
@@ -33,6 +96,13 @@ static void real_time_delay(int64_t num, int32_t denom);
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void timer_init(void) {
+  int level, slot;
+
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    for (slot = 0; slot < WHEEL_SLOTS; slot++)
+      list_init(&wheel[level][slot]);
+  seqlock_init(&ticks_seq);
+
   pit_configure_channel(0, 2, TIMER_FREQ);
   intr_register_ext(0x20, timer_interrupt, "8254 Timer");
 }
@@ -63,9 +133,13 @@ void timer_calibrate(void) {
 
 /* Returns the number of timer ticks since the OS booted. */
 int64_t timer_ticks(void) {
-  enum intr_level old_level = intr_disable();
-  int64_t t = ticks;
-  intr_set_level(old_level);
+  unsigned seq;
+  int64_t t;
+
+  do {
+    seq = seqlock_read_begin(&ticks_seq);
+    t = ticks;
+  } while (seqlock_read_retry(&ticks_seq, seq));
   return t;
 }
 
@@ -76,11 +150,54 @@ int64_t timer_elapsed(int64_t then) { return timer_ticks() - then; }
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
    be turned on. */
 void timer_sleep(int64_t ticks) {
-  int64_t start = timer_ticks();
+  struct timer t;
+  enum intr_level old_level;
 
   ASSERT(intr_get_level() == INTR_ON);
-  while (timer_elapsed(start) < ticks)
-    thread_yield();
+  if (ticks <= 0)
+    return;
+
+  /* Block until a timer unblocks us. */
+  old_level = intr_disable();
+  timer_add(&t, ticks, wake_thread, thread_current());
+  thread_block();
+  intr_set_level(old_level);
+}
+
+/* Arranges for FUNC to be called with AUX as its argument
+   TICKS timer ticks from now, or on the next tick if TICKS is 0
+   or less.  FUNC runs in the timer interrupt handler, with
+   interrupts off, so it must not sleep.  T is the caller's
+   storage for the timer and must remain valid until FUNC has
+   been called or timer_cancel() has returned.  T must not
+   already be pending. */
+void timer_add(struct timer* t, int64_t ticks, timer_func* func, void* aux) {
+  enum intr_level old_level;
+
+  ASSERT(func != NULL);
+
+  old_level = intr_disable();
+  t->expires = timer_ticks() + (ticks > 0 ? ticks : 1);
+  t->func = func;
+  t->aux = aux;
+  t->pending = true;
+  wheel_insert(t);
+  intr_set_level(old_level);
+}
+
+/* Cancels timer T.  Returns true if T was pending, false if it
+   had already run or been canceled. */
+bool timer_cancel(struct timer* t) {
+  enum intr_level old_level = intr_disable();
+  bool was_pending = t->pending;
+
+  if (was_pending) {
+    list_remove(&t->elem);
+    t->pending = false;
+  }
+  intr_set_level(old_level);
+
+  return was_pending;
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -122,15 +239,179 @@ void timer_udelay(int64_t us) { real_time_delay(us, 1000 * 1000); }
    instead if interrupts are enabled.*/
 void timer_ndelay(int64_t ns) { real_time_delay(ns, 1000 * 1000 * 1000); }
 
+/* Called by the idle thread, with interrupts off, just before it
+   halts the CPU.  In tickless mode, stops the periodic tick until
+   the next tick on which a timer is due, if that is at least two
+   ticks away. */
+void timer_idle(void) {
+  unsigned left;
+  bool output;
+  int n;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  if (!timer_tickless || oneshot_end != 0)
+    return;
+
+  n = ticks_until_due(ONESHOT_MAX_TICKS);
+  if (n < 2)
+    return;
+
+  /* Line the one-shot up with the tick boundaries: it runs out
+     the current period, then N - 1 whole ones. */
+  left = pit_read_count(0, &output);
+  if (left > TICK_COUNT)
+    left = TICK_COUNT;
+  oneshot_first = left;
+  oneshot_count = left + (n - 1) * TICK_COUNT;
+  oneshot_start = ticks;
+  oneshot_end = ticks + n;
+  pit_configure_oneshot(0, oneshot_count);
+}
+
+/* Called by intr_handler() on entry to each external interrupt.
+   If the periodic tick is stopped and the one-shot has not yet
+   run out, replays the ticks that have passed and shortens the
+   one-shot to end on the next tick boundary, so that whatever
+   the interrupt sets in motion sees the right time and has its
+   timers run on schedule.  (If the one-shot has run out, its
+   interrupt is this one or is pending, and timer_interrupt()
+   catches up instead.) */
+void timer_wake(void) {
+  unsigned elapsed, left;
+  int64_t passed;
+  bool output;
+
+  if (oneshot_end == 0)
+    return;
+  left = pit_read_count(0, &output);
+  if (output || left > oneshot_count)
+    return;
+
+  /* Replay the whole ticks that have passed. */
+  elapsed = oneshot_count - left;
+  passed = elapsed < oneshot_first ? 0 : 1 + (elapsed - oneshot_first) / TICK_COUNT;
+  while (ticks < oneshot_start + passed) {
+    tick();
+    skipped_ticks++;
+  }
+
+  /* End the one-shot on the next tick boundary. */
+  oneshot_count = oneshot_first + passed * TICK_COUNT - elapsed;
+  if (oneshot_count == 0)
+    oneshot_count = 1;
+  oneshot_first = oneshot_count;
+  oneshot_start = ticks;
+  oneshot_end = ticks + 1;
+  pit_configure_oneshot(0, oneshot_count);
+}
+
 /* Prints timer statistics. */
-void timer_print_stats(void) { printf("Timer: %" PRId64 " ticks\n", timer_ticks()); }
+void timer_print_stats(void) {
+  printf("Timer: %" PRId64 " ticks\n", timer_ticks());
+  if (timer_tickless)
+    printf("Timer: %" PRId64 " ticks skipped while idle\n", skipped_ticks);
+}
 
 /* Timer interrupt handler. */
 static void timer_interrupt(struct intr_frame* args UNUSED) {
+  /* If this is the end of a one-shot, replay the ticks it
+     covered and go back to ticking periodically. */
+  if (oneshot_end != 0) {
+    while (ticks + 1 < oneshot_end) {
+      tick();
+      skipped_ticks++;
+    }
+    oneshot_end = 0;
+    pit_configure_channel(0, 2, TIMER_FREQ);
+  }
+
+  tick();
+}
+
+/* Does the work of one timer tick. */
+static void tick(void) {
+  struct list* slot;
+  int level;
+
+  seqlock_write_begin(&ticks_seq);
   ticks++;
+  seqlock_write_end(&ticks_seq);
+
+  /* Move timers down from each higher level whose current slot
+     has just begun, starting from the top. */
+  for (level = WHEEL_LEVELS - 1; level > 0; level--)
+    if ((ticks & (((int64_t)1 << (WHEEL_BITS * level)) - 1)) == 0)
+      wheel_cascade(level);
+
+  /* Run the timers that expire on this tick. */
+  slot = &wheel[0][ticks & (WHEEL_SLOTS - 1)];
+  while (!list_empty(slot)) {
+    struct timer* t = list_entry(list_pop_front(slot), struct timer, elem);
+    t->pending = false;
+    t->func(t->aux);
+  }
+
   thread_tick();
 }
 
+/* Returns the number of ticks until the first tick, counting the
+   next as 1, on which tick() would run a timer or cascade a
+   nonempty slot, or MAX if there is none within MAX ticks. */
+static int ticks_until_due(int max) {
+  int n, level;
+
+  for (n = 1; n < max; n++) {
+    int64_t t = ticks + n;
+
+    if (!list_empty(&wheel[0][t & (WHEEL_SLOTS - 1)]))
+      return n;
+    for (level = 1; level < WHEEL_LEVELS; level++)
+      if ((t & (((int64_t)1 << (WHEEL_BITS * level)) - 1)) == 0 &&
+          !list_empty(&wheel[level][(t >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)]))
+        return n;
+  }
+  return max;
+}
+
+/* Puts pending timer T in the timer wheel slot for its expiry
+   tick.  Interrupts must be off. */
+static void wheel_insert(struct timer* t) {
+  int64_t expires = t->expires;
+  int64_t delta = expires - ticks;
+  int level = 0;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(delta >= 0);
+
+  /* Find the lowest level that reaches EXPIRES.  A timer beyond
+     the top level waits in its farthest slot. */
+  while (level < WHEEL_LEVELS - 1 && delta >= (int64_t)1 << (WHEEL_BITS * (level + 1)))
+    level++;
+  if (delta >= (int64_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+    expires = ticks + ((int64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+
+  list_push_back(&wheel[level][(expires >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)],
+                 &t->elem);
+}
+
+/* Moves each timer in the current slot of LEVEL of the timer
+   wheel to the slot that now suits it, in a lower level unless
+   it is beyond the top level's reach. */
+static void wheel_cascade(int level) {
+  struct list* slot = &wheel[level][(ticks >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)];
+  struct list timers;
+
+  /* Take the whole slot first, since a timer may go back in it. */
+  list_init(&timers);
+  while (!list_empty(slot))
+    list_push_back(&timers, list_pop_front(slot));
+  while (!list_empty(&timers))
+    wheel_insert(list_entry(list_pop_front(&timers), struct timer, elem));
+}
+
+/* Timer function for timer_sleep(): wakes up thread T. */
+static void wake_thread(void* t) { thread_unblock(t); }
+
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
 static bool too_many_loops(unsigned loops) {
@@ -1,7 +1,9 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
@@ -24,6 +26,26 @@ void timer_mdelay(int64_t milliseconds);
 void timer_udelay(int64_t microseconds);
 void timer_ndelay(int64_t nanoseconds);
 
+/* Timers that call a function after a delay. */
+typedef void timer_func(void* aux);
+
+/* A pending call to a timer function. */
+struct timer {
+  struct list_elem elem; /* Element in timer wheel slot. */
+  int64_t expires;       /* Tick on which to call FUNC. */
+  timer_func* func;      /* Function to call. */
+  void* aux;             /* Argument to FUNC. */
+  bool pending;          /* Added but not yet run or canceled? */
+};
+
+void timer_add(struct timer*, int64_t ticks, timer_func*, void* aux);
+bool timer_cancel(struct timer*);
+
+/* Tickless idle. */
+extern bool timer_tickless;
+void timer_idle(void);
+void timer_wake(void);
+
 void timer_print_stats(void);
 
 #endif /* devices/timer.h */
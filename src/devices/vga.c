@@ -31,6 +31,7 @@ static void cls(void);
 static void newline(void);
 static void move_cursor(void);
 static void find_cursor(size_t* x, size_t* y);
+static void put_char(int c, enum intr_level old_level);
 
 /* Initializes the VGA text display. */
 static void init(void) {
@@ -51,7 +52,34 @@ void vga_putc(int c) {
   enum intr_level old_level = intr_disable();
 
   init();
+  put_char(c, old_level);
 
+  /* Update cursor position. */
+  move_cursor();
+
+  intr_set_level(old_level);
+}
+
+/* Writes the N characters in BUFFER to the VGA text display.
+   Equivalent to calling vga_putc() on each character, but
+   interrupts are disabled and the hardware cursor is moved only
+   once for the whole buffer. */
+void vga_putbuf(const char* buffer, size_t n) {
+  enum intr_level old_level = intr_disable();
+
+  init();
+  while (n-- > 0)
+    put_char(*buffer++, old_level);
+  move_cursor();
+
+  intr_set_level(old_level);
+}
+
+/* Writes C at the cursor position, interpreting control
+   characters in the conventional ways, but does not move the
+   hardware cursor.  Interrupts must be off; OLD_LEVEL is the
+   level to restore temporarily while sounding the bell. */
+static void put_char(int c, enum intr_level old_level) {
   switch (c) {
     case '\n':
       newline();
@@ -89,11 +117,6 @@ void vga_putc(int c) {
         newline();
       break;
   }
-
-  /* Update cursor position. */
-  move_cursor();
-
-  intr_set_level(old_level);
 }
 
 /* Clears the screen and moves the cursor to the upper left. */
@@ -0,0 +1,50 @@
+/* tlbstride.c
+
+   TLB-sensitive benchmark.  Sweeps a large zero-filled array,
+   touching one word in each page, so that nearly every access
+   needs a translation the TLB no longer holds when 4 kB pages
+   back the array.  With 4 MB pages the whole array needs only a
+   handful of TLB entries.
+
+   Run it under the userprog kernel with at least 64 MB of RAM
+   (pintos -m 64), once as is and once with the kernel's -ulpages
+   option, which maps the array with large pages, and compare the
+   "Timer: N ticks" lines the kernel prints at shutdown.  The
+   checksums must match.
+
+   The speedup from -ulpages has not been measured yet; record
+   the two tick counts here once it has. */
+
+#include <stdio.h>
+#include <syscall.h>
+
+/* Size of the array.  Must span at least one whole 4 MB aligned
+   region for large pages to be used. */
+#define ARRAY_SIZE (12 * 1024 * 1024)
+
+/* Size of a (small) page. */
+#define PAGE_SIZE 4096
+
+/* Number of sweeps over the array. */
+#define SWEEPS 200
+
+static int array[ARRAY_SIZE / sizeof(int)];
+
+int main(void) {
+  const int page_ints = PAGE_SIZE / sizeof(int);
+  const int page_cnt = ARRAY_SIZE / PAGE_SIZE;
+  unsigned sum = 0;
+  int sweep, page;
+
+  /* Each sweep touches a different word of each page, so the
+     data cache cannot hide the misses either. */
+  for (sweep = 0; sweep < SWEEPS; sweep++)
+    for (page = 0; page < page_cnt; page++) {
+      int* p = &array[page * page_ints + (sweep * 17) % page_ints];
+      *p += page;
+      sum += *p;
+    }
+
+  printf("tlbstride: %d pages, %d sweeps, checksum %u\n", page_cnt, SWEEPS, sum);
+  return EXIT_SUCCESS;
+}
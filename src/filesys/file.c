@@ -1,7 +1,7 @@
 #include "filesys/file.h"
 #include <debug.h>
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
 
 /* An open file. */
 struct file {
@@ -10,11 +10,17 @@ struct file {
   bool deny_write;     /* Has file_deny_write() been called? */
 };
 
+/* Cache of open files. */
+static struct kmem_cache file_cache;
+
+/* Initializes the open file module. */
+void file_init(void) { kmem_cache_init(&file_cache, "file", sizeof(struct file), NULL); }
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
 struct file* file_open(struct inode* inode) {
-  struct file* file = calloc(1, sizeof *file);
+  struct file* file = kmem_cache_alloc(&file_cache);
   if (inode != NULL && file != NULL) {
     file->inode = inode;
     file->pos = 0;
@@ -22,7 +28,7 @@ struct file* file_open(struct inode* inode) {
     return file;
   } else {
     inode_close(inode);
-    free(file);
+    kmem_cache_free(&file_cache, file);
     return NULL;
   }
 }
@@ -38,7 +44,7 @@ void file_close(struct file* file) {
   if (file != NULL) {
     file_allow_write(file);
     inode_close(file->inode);
-    free(file);
+    kmem_cache_free(&file_cache, file);
   }
 }
 
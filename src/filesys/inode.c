@@ -5,7 +5,9 @@
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 
 /* Identifies an inode. */
@@ -36,8 +38,9 @@ struct inode {
   int open_cnt;          /* Number of openers. */
   bool removed;          /* True if deleted, false otherwise. */
   int deny_write_cnt;    /* 0: writes ok, >0: deny writes. */
+  struct rcu_head rcu;   /* Frees the inode once closed. */
 
-  struct lock inode_lock; // lock for the open_cnt
+  struct lock inode_lock; // lock for removed and deny_write_cnt
 };
 
 /* Returns the block device sector that contains byte offset POS
@@ -75,15 +78,29 @@ static block_sector_t byte_to_sector(const struct inode_disk* inode, off_t pos)
 }
 
 /* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
+   returns the same `struct inode'.  Lookups are RCU readers;
+   changes take open_inodes_lock. */
 static struct list open_inodes;
 
-struct lock open_inodes_lock; // lock for the list of open inodes
+struct lock open_inodes_lock; // lock for changes to the list of open inodes
 
 struct lock resize_lock; // lock for the list of open inodes
 
+/* Cache of in-memory inodes. */
+static struct kmem_cache inode_cache;
+
+/* Constructor for inode_cache.  Each inode's lock is free again
+   by the time inode_close() gives it back. */
+static void inode_ctor(void* inode_) {
+  struct inode* inode = inode_;
+  lock_init(&inode->inode_lock);
+}
+
 block_sector_t block_allocate(void);
 void block_free(block_sector_t n);
+static struct inode* find_open_inode(block_sector_t sector);
+static bool open_cnt_inc_not_zero(struct inode*);
+static void free_inode(struct rcu_head*);
 
 /* Allocates a disk sector and returns its number. */
 block_sector_t block_allocate(void) {
@@ -242,9 +259,10 @@ bool inode_resize(struct inode_disk* inode, off_t size) {
 
 /* Initializes the inode module. */
 void inode_init(void) {
+  kmem_cache_init(&inode_cache, "inode", sizeof(struct inode), inode_ctor);
   list_init(&open_inodes);
-  lock_init(&open_inodes_lock);
-  lock_init(&resize_lock);
+  lock_init_named(&open_inodes_lock, "open_inodes_lock");
+  lock_init_named(&resize_lock, "resize_lock");
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -284,47 +302,74 @@ bool inode_create(block_sector_t sector, off_t length, bool is_dir) {
    and returns a `struct inode' that contains it.
    Returns a null pointer if memory allocation fails. */
 struct inode* inode_open(block_sector_t sector) {
-  struct list_elem* e;
-  struct inode* inode;
+  struct inode *inode, *new_inode;
 
   /* Check whether this inode is already open. */
-  lock_acquire(&open_inodes_lock);
-  for (e = list_begin(&open_inodes); e != list_end(&open_inodes); e = list_next(e)) {
-    inode = list_entry(e, struct inode, elem);
-    if (inode->sector == sector) {
-      inode_reopen(inode);
-      lock_release(&open_inodes_lock);
-      return inode;
-    }
-  }
-  lock_release(&open_inodes_lock);
-
-  /* Allocate memory. */
-  inode = malloc(sizeof *inode);
-  if (inode == NULL)
+  rcu_read_lock();
+  inode = find_open_inode(sector);
+  rcu_read_unlock();
+  if (inode != NULL)
+    return inode;
+
+  /* Allocate memory.  The cache has already initialized the
+     inode's lock. */
+  new_inode = kmem_cache_alloc(&inode_cache);
+  if (new_inode == NULL)
     return NULL;
 
   /* Initialize. */
+  new_inode->sector = sector;
+  new_inode->open_cnt = 1;
+  new_inode->deny_write_cnt = 0;
+  new_inode->removed = false;
+
+  /* Add it to the list, unless someone else opened the inode
+     while we were allocating. */
   lock_acquire(&open_inodes_lock);
-  list_push_front(&open_inodes, &inode->elem);
+  inode = find_open_inode(sector);
+  if (inode == NULL) {
+    inode = new_inode;
+    rcu_list_push_front(&open_inodes, &inode->elem);
+  }
   lock_release(&open_inodes_lock);
-
-  lock_init(&inode->inode_lock);
-  lock_acquire(&inode->inode_lock);
-  inode->sector = sector;
-  inode->open_cnt = 1;
-  inode->deny_write_cnt = 0;
-  inode->removed = false;
-  lock_release(&inode->inode_lock);
+  if (inode != new_inode)
+    kmem_cache_free(&inode_cache, new_inode);
   return inode;
 }
 
+/* Returns the open inode for SECTOR, reopened, or a null pointer
+   if it is not open.  An inode whose last opener is closing it
+   does not count.  Must be called within an RCU read-side
+   critical section or with open_inodes_lock held. */
+static struct inode* find_open_inode(block_sector_t sector) {
+  struct list_elem* e;
+
+  for (e = list_begin(&open_inodes); e != list_end(&open_inodes); e = list_next(e)) {
+    struct inode* inode = list_entry(e, struct inode, elem);
+    if (inode->sector == sector && open_cnt_inc_not_zero(inode))
+      return inode;
+  }
+  return NULL;
+}
+
+/* Increments INODE's open count, unless it has already dropped to
+   0, and returns true if it did so.  The open count is changed
+   only with interrupts off, so that RCU readers need no lock to
+   change it. */
+static bool open_cnt_inc_not_zero(struct inode* inode) {
+  enum intr_level old_level = intr_disable();
+  bool success = inode->open_cnt > 0;
+  if (success)
+    inode->open_cnt++;
+  intr_set_level(old_level);
+  return success;
+}
+
 /* Reopens and returns INODE. */
 struct inode* inode_reopen(struct inode* inode) {
   if (inode != NULL) {
-    lock_acquire(&inode->inode_lock);
-    inode->open_cnt++;
-    lock_release(&inode->inode_lock);
+    bool success = open_cnt_inc_not_zero(inode);
+    ASSERT(success);
   }
   return inode;
 }
@@ -336,16 +381,23 @@ block_sector_t inode_get_inumber(const struct inode* inode) { return inode->sect
    If this was the last reference to INODE, frees its memory.
    If INODE was also a removed inode, frees its blocks. */
 void inode_close(struct inode* inode) {
+  enum intr_level old_level;
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
-  bool r = true;
+  old_level = intr_disable();
+  last = --inode->open_cnt == 0;
+  intr_set_level(old_level);
+
   /* Release resources if this was the last opener. */
-  lock_acquire(&inode->inode_lock);
-  if (--inode->open_cnt == 0) {
-    /* Remove from inode list and release lock. */
-    list_remove(&inode->elem);
+  if (last) {
+    /* Remove from inode list. */
+    lock_acquire(&open_inodes_lock);
+    rcu_list_remove(&inode->elem);
+    lock_release(&open_inodes_lock);
 
     /* Deallocate blocks if removed. */
     if (inode->removed) {
@@ -356,15 +408,17 @@ void inode_close(struct inode* inode) {
 
       block_free(inode->sector);
     }
-    r = false;
-    lock_release(&inode->inode_lock);
-    free(inode);
-  }
-  if (r) {
-    lock_release(&inode->inode_lock);
+
+    /* A lookup may still be looking at the inode. */
+    call_rcu(&inode->rcu, free_inode);
   }
 }
 
+/* RCU callback that frees the inode containing HEAD. */
+static void free_inode(struct rcu_head* head) {
+  kmem_cache_free(&inode_cache, rcu_entry(head, struct inode, rcu));
+}
+
 /* Marks INODE to be deleted when it is closed by the last caller who
    has it open. */
 void inode_remove(struct inode* inode) {
@@ -614,7 +668,7 @@ void cache_init() {
   num_miss = 0;
 
   // Init the main lock
-  lock_init(&cache_lock);
+  lock_init_named(&cache_lock, "cache_lock");
 
   // Init all the sectors
   for (int i = 0; i < MAX_NUM_SECTORS; i++) {
@@ -61,7 +61,7 @@ static int64_t write_cnt;
 
 /* Enable console locking. */
 void console_init(void) {
-  lock_init(&console_lock);
+  lock_init_named(&console_lock, "console_lock");
   use_console_lock = true;
 }
 
@@ -127,8 +127,9 @@ int puts(const char* s) {
 /* Writes the N characters in BUFFER to the console. */
 void putbuf(const char* buffer, size_t n) {
   acquire_console();
-  while (n-- > 0)
-    putchar_have_lock(*buffer++);
+  write_cnt += n;
+  serial_putbuf(buffer, n);
+  vga_putbuf(buffer, n);
   release_console();
 }
 
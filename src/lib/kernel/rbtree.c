@@ -0,0 +1,288 @@
+#include "rbtree.h"
+#include "../debug.h"
+
+/* The algorithms are those of [CLRS] chapter 13, except that
+   null pointers stand in for the black leaf sentinels.  Where the
+   sentinel's parent pointer would be used, the parent is carried
+   along explicitly instead. */
+
+static bool is_red(const struct rb_elem*);
+static void replace_child(struct rb_tree*, struct rb_elem* old, struct rb_elem* new);
+static void rotate_left(struct rb_tree*, struct rb_elem*);
+static void rotate_right(struct rb_tree*, struct rb_elem*);
+static void insert_fixup(struct rb_tree*, struct rb_elem*);
+static void remove_fixup(struct rb_tree*, struct rb_elem*, struct rb_elem* parent);
+
+/* Initializes TREE as an empty tree ordered by LESS given
+   auxiliary data AUX. */
+void rb_init(struct rb_tree* tree, rb_less_func* less, void* aux) {
+  ASSERT(tree != NULL);
+  ASSERT(less != NULL);
+
+  tree->root = tree->min = NULL;
+  tree->size = 0;
+  tree->less = less;
+  tree->aux = aux;
+}
+
+/* Inserts ELEM into TREE, after any elements equal to it. */
+void rb_insert(struct rb_tree* tree, struct rb_elem* elem) {
+  struct rb_elem** link = &tree->root;
+  struct rb_elem* parent = NULL;
+  bool leftmost = true;
+
+  ASSERT(tree != NULL);
+  ASSERT(elem != NULL);
+
+  while (*link != NULL) {
+    parent = *link;
+    if (tree->less(elem, parent, tree->aux))
+      link = &parent->left;
+    else {
+      link = &parent->right;
+      leftmost = false;
+    }
+  }
+
+  elem->parent = parent;
+  elem->left = elem->right = NULL;
+  elem->red = true;
+  *link = elem;
+  if (leftmost)
+    tree->min = elem;
+  tree->size++;
+
+  insert_fixup(tree, elem);
+}
+
+/* Removes ELEM, which must be in TREE, from TREE. */
+void rb_remove(struct rb_tree* tree, struct rb_elem* elem) {
+  struct rb_elem* child;  /* Node that takes the removed node's place. */
+  struct rb_elem* parent; /* CHILD's parent. */
+  bool removed_red;       /* Color of the node removed from its place. */
+
+  ASSERT(tree != NULL);
+  ASSERT(elem != NULL);
+
+  if (tree->min == elem)
+    tree->min = rb_next(elem);
+
+  if (elem->left == NULL || elem->right == NULL) {
+    /* ELEM has at most one child, which replaces it. */
+    child = elem->left != NULL ? elem->left : elem->right;
+    parent = elem->parent;
+    removed_red = elem->red;
+    replace_child(tree, elem, child);
+  } else {
+    /* ELEM's successor NEXT has no left child.  Move NEXT into
+       ELEM's place, and NEXT's right child into NEXT's. */
+    struct rb_elem* next = elem->right;
+    while (next->left != NULL)
+      next = next->left;
+
+    child = next->right;
+    removed_red = next->red;
+    if (next->parent == elem)
+      parent = next;
+    else {
+      parent = next->parent;
+      replace_child(tree, next, child);
+      next->right = elem->right;
+      next->right->parent = next;
+    }
+    replace_child(tree, elem, next);
+    next->left = elem->left;
+    next->left->parent = next;
+    next->red = elem->red;
+  }
+  tree->size--;
+
+  if (!removed_red)
+    remove_fixup(tree, child, parent);
+}
+
+/* Returns the least element in TREE, or a null pointer if TREE
+   is empty. */
+struct rb_elem* rb_min(const struct rb_tree* tree) {
+  ASSERT(tree != NULL);
+  return tree->min;
+}
+
+/* Returns the element that follows ELEM in its tree, or a null
+   pointer if ELEM is the greatest element. */
+struct rb_elem* rb_next(struct rb_elem* elem) {
+  ASSERT(elem != NULL);
+
+  if (elem->right != NULL) {
+    elem = elem->right;
+    while (elem->left != NULL)
+      elem = elem->left;
+    return elem;
+  }
+  while (elem->parent != NULL && elem == elem->parent->right)
+    elem = elem->parent;
+  return elem->parent;
+}
+
+/* Returns the number of elements in TREE. */
+size_t rb_size(const struct rb_tree* tree) {
+  ASSERT(tree != NULL);
+  return tree->size;
+}
+
+/* Returns true if TREE is empty, false otherwise. */
+bool rb_empty(const struct rb_tree* tree) {
+  ASSERT(tree != NULL);
+  return tree->root == NULL;
+}
+
+/* Returns true if E is a red node, false if it is black or a
+   null leaf. */
+static bool is_red(const struct rb_elem* e) { return e != NULL && e->red; }
+
+/* Makes NEW, which may be null, take the place of OLD as a child
+   of OLD's parent, or as the root of TREE. */
+static void replace_child(struct rb_tree* tree, struct rb_elem* old, struct rb_elem* new) {
+  struct rb_elem* parent = old->parent;
+
+  if (parent == NULL)
+    tree->root = new;
+  else if (old == parent->left)
+    parent->left = new;
+  else
+    parent->right = new;
+  if (new != NULL)
+    new->parent = parent;
+}
+
+/* Rotates E's right child into E's place. */
+static void rotate_left(struct rb_tree* tree, struct rb_elem* e) {
+  struct rb_elem* r = e->right;
+
+  e->right = r->left;
+  if (r->left != NULL)
+    r->left->parent = e;
+  replace_child(tree, e, r);
+  r->left = e;
+  e->parent = r;
+}
+
+/* Rotates E's left child into E's place. */
+static void rotate_right(struct rb_tree* tree, struct rb_elem* e) {
+  struct rb_elem* l = e->left;
+
+  e->left = l->right;
+  if (l->right != NULL)
+    l->right->parent = e;
+  replace_child(tree, e, l);
+  l->right = e;
+  e->parent = l;
+}
+
+/* Restores the red-black properties after red node E has been
+   inserted into TREE. */
+static void insert_fixup(struct rb_tree* tree, struct rb_elem* e) {
+  struct rb_elem* parent;
+
+  while ((parent = e->parent) != NULL && parent->red) {
+    /* PARENT is red, so it is not the root. */
+    struct rb_elem* grandparent = parent->parent;
+
+    if (parent == grandparent->left) {
+      struct rb_elem* uncle = grandparent->right;
+      if (is_red(uncle)) {
+        parent->red = uncle->red = false;
+        grandparent->red = true;
+        e = grandparent;
+      } else {
+        if (e == parent->right) {
+          rotate_left(tree, parent);
+          parent = e;
+        }
+        parent->red = false;
+        grandparent->red = true;
+        rotate_right(tree, grandparent);
+        break;
+      }
+    } else {
+      struct rb_elem* uncle = grandparent->left;
+      if (is_red(uncle)) {
+        parent->red = uncle->red = false;
+        grandparent->red = true;
+        e = grandparent;
+      } else {
+        if (e == parent->left) {
+          rotate_right(tree, parent);
+          parent = e;
+        }
+        parent->red = false;
+        grandparent->red = true;
+        rotate_left(tree, grandparent);
+        break;
+      }
+    }
+  }
+  tree->root->red = false;
+}
+
+/* Restores the red-black properties after a black node has been
+   removed from TREE, leaving E, which may be null, in its place
+   as a child of PARENT.  E carries an extra black. */
+static void remove_fixup(struct rb_tree* tree, struct rb_elem* e, struct rb_elem* parent) {
+  while (e != tree->root && !is_red(e)) {
+    /* E carries an extra black, so its sibling is not null. */
+    if (e == parent->left) {
+      struct rb_elem* sibling = parent->right;
+      if (sibling->red) {
+        sibling->red = false;
+        parent->red = true;
+        rotate_left(tree, parent);
+        sibling = parent->right;
+      }
+      if (!is_red(sibling->left) && !is_red(sibling->right)) {
+        sibling->red = true;
+        e = parent;
+        parent = e->parent;
+      } else {
+        if (!is_red(sibling->right)) {
+          sibling->left->red = false;
+          sibling->red = true;
+          rotate_right(tree, sibling);
+          sibling = parent->right;
+        }
+        sibling->red = parent->red;
+        parent->red = false;
+        sibling->right->red = false;
+        rotate_left(tree, parent);
+        e = tree->root;
+      }
+    } else {
+      struct rb_elem* sibling = parent->left;
+      if (sibling->red) {
+        sibling->red = false;
+        parent->red = true;
+        rotate_right(tree, parent);
+        sibling = parent->left;
+      }
+      if (!is_red(sibling->left) && !is_red(sibling->right)) {
+        sibling->red = true;
+        e = parent;
+        parent = e->parent;
+      } else {
+        if (!is_red(sibling->left)) {
+          sibling->right->red = false;
+          sibling->red = true;
+          rotate_left(tree, sibling);
+          sibling = parent->left;
+        }
+        sibling->red = parent->red;
+        parent->red = false;
+        sibling->left->red = false;
+        rotate_right(tree, parent);
+        e = tree->root;
+      }
+    }
+  }
+  if (e != NULL)
+    e->red = false;
+}
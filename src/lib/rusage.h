@@ -0,0 +1,21 @@
+#ifndef __LIB_RUSAGE_H
+#define __LIB_RUSAGE_H
+
+#include <stdint.h>
+
+/* Values for getrusage()'s WHO argument. */
+#define RUSAGE_SELF 0      /* All threads in the calling process. */
+#define RUSAGE_CHILDREN -1 /* Child processes that have been waited for. */
+#define RUSAGE_THREAD 1    /* The calling thread. */
+
+/* CPU usage of a thread or process.  Times are in CPU clock
+   cycles, as counted by the time-stamp counter. */
+struct rusage {
+  uint64_t user_cycles;    /* Time running in user mode. */
+  uint64_t kernel_cycles;  /* Time running in the kernel. */
+  uint64_t wait_cycles;    /* Time ready to run but not running. */
+  unsigned vol_switches;   /* Times the CPU was given up by blocking. */
+  unsigned invol_switches; /* Times the CPU was given up while ready. */
+};
+
+#endif /* lib/rusage.h */
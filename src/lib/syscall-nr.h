@@ -33,6 +33,7 @@ enum {
   /* Project 3 and optionally project 4. */
   SYS_MMAP,   /* Map a file into memory. */
   SYS_MUNMAP, /* Remove a memory mapping. */
+  SYS_FORK,   /* Clone this process, copy-on-write. */
 
   /* Project 4 only. */
   SYS_CHDIR,   /* Change the current directory. */
@@ -43,7 +44,9 @@ enum {
 
   SYS_CACHE_RESET, /* Resets the cache */
   SYS_GET_HITS,    /* Returns number of hits in the cache */
-  SYS_WRITE_COUNT  /* Return number of write counts */
+  SYS_WRITE_COUNT, /* Return number of write counts */
+
+  SYS_GETRUSAGE /* Obtain CPU usage. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -106,6 +106,8 @@ mapid_t mmap(int fd, void* addr) { return syscall2(SYS_MMAP, fd, addr); }
 
 void munmap(mapid_t mapid) { syscall1(SYS_MUNMAP, mapid); }
 
+pid_t fork(void) { return (pid_t)syscall0(SYS_FORK); }
+
 bool chdir(const char* dir) { return syscall1(SYS_CHDIR, dir); }
 
 bool mkdir(const char* dir) { return syscall1(SYS_MKDIR, dir); }
@@ -120,6 +122,8 @@ void cache_rest() { return syscall0(SYS_CACHE_RESET); }
 int cache_num_hits() { return syscall0(SYS_GET_HITS); }
 unsigned long long get_write_count() { return syscall0(SYS_WRITE_COUNT); }
 
+bool getrusage(int who, struct rusage* usage) { return syscall2(SYS_GETRUSAGE, who, usage); }
+
 double compute_e(int n) { return (double)syscall1f(SYS_COMPUTE_E, n); }
 
 tid_t sys_pthread_create(stub_fun sfun, pthread_fun tfun, const void* arg) {
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <debug.h>
 #include <pthread.h>
+#include <rusage.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -54,6 +55,7 @@ tid_t get_tid(void);
 /* Project 3 and optionally project 4. */
 mapid_t mmap(int fd, void* addr);
 void munmap(mapid_t);
+pid_t fork(void);
 
 /* Project 4 only. */
 bool chdir(const char* dir);
@@ -66,4 +68,6 @@ void cache_rest();
 int cache_num_hits();
 unsigned long long get_write_count();
 
+bool getrusage(int who, struct rusage* usage);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,168 @@
+/* Stress test and benchmark for the page allocator.
+
+   Runs one random mix of 1, 2, 4, and 8-page allocations and
+   frees against palloc's user pool, which is a buddy allocator,
+   and then against a bitmap searched first-fit with
+   bitmap_scan_and_flip(), which is how palloc used to work.  For
+   each, reports how many allocations failed even though enough
+   pages were free (a measure of fragmentation), the largest
+   power-of-2 run that could still be allocated at the end, and
+   the average number of cycles per allocation.
+
+   Along the way, checks that no two live allocations from the
+   page allocator overlap.
+
+   Not part of the graded tests, since its output varies from
+   run to run: use "pintos -- run palloc-stress". */
+
+#include <bitmap.h>
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+
+/* Number of allocate-or-free steps in each run. */
+#define STEPS 5000
+
+/* Seed for the random sequence, the same for both runs. */
+#define SEED 0x5eed
+
+/* A page allocator under test.  ALLOC returns a nonzero handle
+   for PAGE_CNT pages, or 0 on failure. */
+struct allocator {
+  const char* name;
+  uintptr_t (*alloc)(size_t page_cnt);
+  void (*free)(uintptr_t, size_t page_cnt);
+  bool touch; /* Whether handles are addresses of real pages. */
+};
+
+/* The bitmap in the bitmap allocator. */
+static struct bitmap* map;
+
+static uintptr_t palloc_alloc(size_t page_cnt) {
+  return (uintptr_t)palloc_get_multiple(PAL_USER, page_cnt);
+}
+
+static void palloc_free(uintptr_t pages, size_t page_cnt) {
+  palloc_free_multiple((void*)pages, page_cnt);
+}
+
+static uintptr_t bitmap_alloc(size_t page_cnt) {
+  size_t idx = bitmap_scan_and_flip(map, 0, page_cnt, false);
+  return idx != BITMAP_ERROR ? idx + 1 : 0;
+}
+
+static void bitmap_free(uintptr_t idx, size_t page_cnt) {
+  bitmap_set_multiple(map, idx - 1, page_cnt, false);
+}
+
+static const struct allocator buddy = {"buddy", palloc_alloc, palloc_free, true};
+static const struct allocator first_fit = {"bitmap", bitmap_alloc, bitmap_free, false};
+
+/* Returns the number of pages in the user pool. */
+static size_t count_user_pages(void) {
+  void* head = NULL;
+  size_t cnt = 0;
+  void* page;
+
+  /* Chain the pages together through their first word. */
+  while ((page = palloc_get_page(PAL_USER)) != NULL) {
+    *(void**)page = head;
+    head = page;
+    cnt++;
+  }
+  while (head != NULL) {
+    page = head;
+    head = *(void**)page;
+    palloc_free_page(page);
+  }
+  return cnt;
+}
+
+/* Runs the random sequence against A, with SLOT_CNT slots that
+   each hold one allocation or none, out of a pool of POOL_PAGES
+   pages. */
+static void run(const struct allocator* a, size_t slot_cnt, size_t pool_pages) {
+  static const size_t sizes[] = {1, 2, 4, 8};
+  uintptr_t* handles = calloc(slot_cnt, sizeof *handles);
+  size_t* counts = calloc(slot_cnt, sizeof *counts);
+  size_t used = 0, allocs = 0, failures = 0, largest = 0;
+  uint64_t cycles = 0;
+  size_t step, slot, n;
+
+  ASSERT(handles != NULL && counts != NULL);
+  random_init(SEED);
+  for (step = 0; step < STEPS; step++) {
+    slot = random_ulong() % slot_cnt;
+    if (handles[slot] != 0) {
+      if (a->touch)
+        for (n = 0; n < counts[slot]; n++)
+          if (*(size_t*)(handles[slot] + n * PGSIZE) != slot)
+            fail("%s: page %zu of slot %zu overwritten", a->name, n, slot);
+      a->free(handles[slot], counts[slot]);
+      used -= counts[slot];
+      handles[slot] = 0;
+    } else {
+      size_t page_cnt = sizes[random_ulong() % 4];
+      uint64_t start = rdtsc();
+      uintptr_t h = a->alloc(page_cnt);
+      cycles += rdtsc() - start;
+      allocs++;
+      if (h == 0) {
+        if (used + page_cnt <= pool_pages)
+          failures++;
+        continue;
+      }
+      if (a->touch)
+        for (n = 0; n < page_cnt; n++)
+          *(size_t*)(h + n * PGSIZE) = slot;
+      handles[slot] = h;
+      counts[slot] = page_cnt;
+      used += page_cnt;
+    }
+  }
+
+  /* Find the largest power-of-2 run still available. */
+  for (n = 1; n <= pool_pages; n *= 2) {
+    uintptr_t h = a->alloc(n);
+    if (h == 0)
+      break;
+    a->free(h, n);
+    largest = n;
+  }
+
+  for (slot = 0; slot < slot_cnt; slot++)
+    if (handles[slot] != 0)
+      a->free(handles[slot], counts[slot]);
+  free(handles);
+  free(counts);
+
+  printf("%s: %zu allocations, %zu failed from fragmentation, "
+         "largest free run %zu pages, %llu cycles per allocation\n",
+         a->name, allocs, failures, largest, allocs > 0 ? cycles / allocs : 0);
+}
+
+void test_palloc_stress(void) {
+  size_t pool_pages = count_user_pages();
+  size_t slot_cnt;
+
+  /* About half the slots are full at a time, holding 3.75 pages
+     on average, so this keeps the pool nearly full. */
+  slot_cnt = pool_pages / 2;
+  ASSERT(slot_cnt > 0);
+  msg("user pool has %zu pages", pool_pages);
+
+  map = bitmap_create(pool_pages);
+  ASSERT(map != NULL);
+  run(&buddy, slot_cnt, pool_pages);
+  run(&first_fit, slot_cnt, pool_pages);
+  bitmap_destroy(map);
+
+  if (count_user_pages() != pool_pages)
+    fail("pages leaked from the user pool");
+  msg("no overlapping allocations or leaks");
+}
@@ -0,0 +1,37 @@
+/* Checks that getrusage() accounts for the CPU time that a
+   process burns in user mode and in the kernel, and for that of
+   the children it waits for. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Spins for a while in user mode. */
+static void spin(void) {
+  volatile int i;
+  for (i = 0; i < 10000000; i++)
+    continue;
+}
+
+void test_main(void) {
+  struct rusage before, after, children;
+
+  CHECK(getrusage(RUSAGE_SELF, &before), "getrusage(RUSAGE_SELF)");
+  spin();
+  CHECK(getrusage(RUSAGE_SELF, &after), "getrusage(RUSAGE_SELF)");
+  if (after.user_cycles <= before.user_cycles)
+    fail("user time did not increase while spinning");
+  if (after.kernel_cycles == 0)
+    fail("no kernel time recorded");
+
+  CHECK(getrusage(RUSAGE_CHILDREN, &children), "getrusage(RUSAGE_CHILDREN)");
+  if (children.user_cycles != 0)
+    fail("user time recorded for children before any were waited for");
+  msg("wait(exec()) = %d", wait(exec("child-simple")));
+  CHECK(getrusage(RUSAGE_CHILDREN, &children), "getrusage(RUSAGE_CHILDREN)");
+  if (children.user_cycles == 0 || children.kernel_cycles == 0)
+    fail("child's time was not recorded");
+
+  if (getrusage(1234, &after))
+    fail("getrusage() accepted an invalid WHO");
+}
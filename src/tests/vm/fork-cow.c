@@ -0,0 +1,36 @@
+/* Forks a child that overwrites a buffer the parent has already
+   filled in, and verifies that the child starts out seeing the
+   parent's data but that its writes stay out of the parent's
+   memory. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 1024)
+
+static char buf[SIZE];
+
+void test_main(void) {
+  pid_t child;
+  size_t i;
+
+  memset(buf, 'p', SIZE);
+
+  child = fork();
+  if (child == 0) {
+    for (i = 0; i < SIZE; i++)
+      if (buf[i] != 'p')
+        fail("child sees byte %zu as '%c' instead of 'p'", i, buf[i]);
+    memset(buf, 'c', SIZE);
+    exit(42);
+  }
+
+  CHECK(child != PID_ERROR, "fork");
+  CHECK(wait(child) == 42, "wait for child");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != 'p')
+      fail("byte %zu changed to '%c' by child", i, buf[i]);
+  msg("parent's memory unchanged");
+}
@@ -0,0 +1,13 @@
+/* Verifies that memory mappings at a kernel address are
+   disallowed. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  int handle;
+
+  CHECK((handle = open("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK(mmap(handle, (void*)0xc0001000) == MAP_FAILED, "try to mmap at kernel address");
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-kernel) begin
+(mmap-kernel) open "sample.txt"
+(mmap-kernel) try to mmap at kernel address
+(mmap-kernel) end
+EOF
+pass;
@@ -22,6 +22,8 @@
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/sched-trace.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -40,6 +42,11 @@
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t* init_page_dir;
@@ -60,8 +67,19 @@ static const char* swap_bdev_name;
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+/* -txq: Number of pages in the serial port's transmit queue. */
+static size_t serial_txq_pages = 1;
+
+/* -sched-trace: Record scheduler events? */
+static bool sched_trace_requested;
+
+/* PSE bit in CR4 and in the CPUID feature flags in EDX. */
+#define CR4_PSE 0x10
+#define CPUID_PSE 0x8
+
 static void bss_init(void);
 static void paging_init(void);
+static bool cpu_has_pse(void);
 
 static char** read_command_line(void);
 static char** parse_options(char** argv);
@@ -95,7 +113,12 @@ int main(void) {
   /* Initialize memory system. */
   palloc_init(user_page_limit);
   malloc_init();
+  if (sched_trace_requested)
+    sched_trace_init();
   paging_init();
+#ifdef VM
+  frame_init();
+#endif
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -115,7 +138,8 @@ int main(void) {
 
   /* Start thread scheduler and enable interrupts. */
   thread_start();
-  serial_init_queue();
+  rcu_init();
+  serial_init_queue(serial_txq_pages);
   timer_calibrate();
 
 #ifdef FILESYS
@@ -125,6 +149,11 @@ int main(void) {
   filesys_init(format_filesys);
 #endif
 
+#ifdef VM
+  /* Set up swapping, now that the swap device is known. */
+  swap_init();
+#endif
+
 #ifdef USERPROG
   /* Give main thread a minimal PCB so it can launch the first process */
   userprog_init();
@@ -154,12 +183,27 @@ static void bss_init(void) {
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports PSE, each 4 MB chunk of RAM is mapped by a
+   single large page, which takes one TLB entry instead of 1,024.
+   The chunk that holds the kernel's code still gets a page table,
+   so that the code can stay read-only, and so does a partial
+   chunk at the end of RAM. */
 static void paging_init(void) {
   uint32_t *pd, *pt;
   size_t page;
+  bool pse = cpu_has_pse();
   extern char _start, _end_kernel_text;
 
+  /* Large PDEs must not be loaded into CR3 before PSE is on.
+     See [IA32-v3a] 2.5 "Control Registers". */
+  if (pse) {
+    uint32_t cr4;
+    asm volatile("movl %%cr4, %0" : "=r"(cr4));
+    asm volatile("movl %0, %%cr4" : : "r"(cr4 | CR4_PSE));
+  }
+
   pd = init_page_dir = palloc_get_page(PAL_ASSERT | PAL_ZERO);
   pt = NULL;
   for (page = 0; page < init_ram_pages; page++) {
@@ -170,6 +214,12 @@ static void paging_init(void) {
     bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
     if (pd[pde_idx] == 0) {
+      if (pse && page + LPGPAGES <= init_ram_pages &&
+          (vaddr + LPGSIZE <= &_start || vaddr >= &_end_kernel_text)) {
+        pd[pde_idx] = pde_create_large(vaddr, true, false);
+        page += LPGPAGES - 1;
+        continue;
+      }
       pt = palloc_get_page(PAL_ASSERT | PAL_ZERO);
       pd[pde_idx] = pde_create(pt);
     }
@@ -185,6 +235,15 @@ static void paging_init(void) {
   asm volatile("movl %0, %%cr3" : : "r"(vtop(init_page_dir)));
 }
 
+/* Returns true if the CPU supports 4 MB pages.  See [IA32-v2a]
+   "CPUID--CPU Identification". */
+static bool cpu_has_pse(void) {
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+  return (edx & CPUID_PSE) != 0;
+}
+
 /* Breaks the kernel command line into words and returns them as
    an argv-like array. */
 static char** read_command_line(void) {
@@ -243,10 +302,24 @@ static char** parse_options(char** argv) {
 #ifdef VM
     else if (!strcmp(name, "-swap"))
       swap_bdev_name = value;
+    else if (!strcmp(name, "-ustack")) {
+      stack_page_limit = atoi(value);
+      if (stack_page_limit == 0)
+        PANIC("user stacks must be allowed at least one page");
+    }
 #endif
 #endif
     else if (!strcmp(name, "-rs"))
       random_init(atoi(value));
+    else if (!strcmp(name, "-txq")) {
+      serial_txq_pages = atoi(value);
+      if (serial_txq_pages == 0)
+        PANIC("serial transmit queue must have at least one page");
+    }
+    else if (!strcmp(name, "-sched-trace"))
+      sched_trace_requested = true;
+    else if (!strcmp(name, "-tickless"))
+      timer_tickless = true;
     else if (!strcmp(name, "-sched")) {
       if (!strcmp(value, "fifo"))
         scheduler_flags[SCHED_FIFO] = 1;
@@ -262,6 +335,10 @@ static char** parse_options(char** argv) {
 #ifdef USERPROG
     else if (!strcmp(name, "-ul"))
       user_page_limit = atoi(value);
+#ifndef VM
+    else if (!strcmp(name, "-ulpages"))
+      user_large_pages = true;
+#endif
 #endif
     else
       PANIC("unknown option `%s' (use -h for help)", name);
@@ -422,17 +499,24 @@ static void usage(void) {
          "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
 #ifdef VM
          "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+         "  -ustack=PAGES      Let user stacks grow to at most PAGES pages.\n"
 #endif // VM
 #endif // FILESYS
          "  -rs=SEED           Set random number seed to SEED.\n"
+         "  -txq=PAGES         Use PAGES pages for the serial transmit queue.\n"
          "  -sched-fair        Use alternate non-strict priority scheduler. Mutually exclusive "
          "with \"-sched-mlfqs\", \"-sched-prio\".\n"
          "  -sched-mlfqs       Use multi-level feedback queue scheduler. Mutually exclusive with "
          "\"-sched-fair\", \"-sched-prio\".\n"
          "  -sched-prio        Use strict-priority round-robin scheduler. Mutually exclusive with "
          "\"-sched-fair\", \"-sched-mlfqs\".\n"
+         "  -sched-trace       Record scheduler events and print them at power off.\n"
+         "  -tickless          Stop the timer interrupt while idle.\n"
 #ifdef USERPROG
          "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#ifndef VM
+         "  -ulpages           Map big zero-filled user regions with 4 MB pages.\n"
+#endif // VM
 #endif // USERPROG
   );
   shutdown_power_off();
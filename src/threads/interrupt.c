@@ -6,6 +6,7 @@
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
@@ -320,6 +321,14 @@ void intr_handler(struct intr_frame* frame) {
   bool external;
   intr_handler_func* handler;
 
+#ifdef USERPROG
+  /* Entering the kernel from user mode ends a stretch of user
+     time. */
+  bool from_user = frame->cs == SEL_UCSEG;
+  if (from_user)
+    thread_charge_cpu(true);
+#endif
+
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
      and they need to be acknowledged on the PIC (see below).
@@ -331,6 +340,10 @@ void intr_handler(struct intr_frame* frame) {
 
     in_external_intr = true;
     yield_on_return = false;
+
+    /* Bring the time up to date if the CPU was idling without
+       a periodic tick. */
+    timer_wake();
   }
 
   /* Invoke the interrupt's handler. */
@@ -352,9 +365,16 @@ void intr_handler(struct intr_frame* frame) {
     in_external_intr = false;
     pic_end_of_interrupt(frame->vec_no);
 
-    if (yield_on_return)
+    if (yield_on_return && rcu_preemptible())
       thread_yield();
   }
+
+#ifdef USERPROG
+  /* The time since entry, less any time that other threads ran
+     in the meantime, was spent in the kernel. */
+  if (from_user)
+    thread_charge_cpu(false);
+#endif
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
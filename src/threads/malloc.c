@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -26,7 +27,21 @@
    When we free a block, we add it to its descriptor's free list.
    But if the arena that the block was in now has no in-use
    blocks, we remove all of the arena's blocks from the free list
-   and give the arena back to the page allocator.
+   and give the arena back to the page allocator, unless the
+   descriptor has fewer than SPARE_ARENAS such arenas already.
+   Keeping a few spares stops a workload that allocates and frees
+   one block over and over from getting and freeing a page each
+   time.
+
+   In front of each descriptor's free list sits a "magazine", a
+   small stack of free blocks.  malloc() and free() use it with
+   interrupts disabled for a few instructions instead of taking
+   the descriptor's lock, which is the per-CPU cache of a
+   multiprocessor allocator in our uniprocessor world.  Only when
+   the magazine runs empty or full do they take the lock, and
+   then they move half a magazine's worth of blocks at once.
+   Blocks in a magazine count as in use as far as their arenas
+   are concerned.
 
    We can't handle blocks bigger than 2 kB using this scheme,
    because they're too big to fit in a single page with a
@@ -34,12 +49,27 @@
    with the page allocator and sticking the allocation size at
    the beginning of the allocated block's arena header. */
 
+/* Number of free blocks a magazine holds. */
+#define MAG_SIZE 16
+
+/* Number of entirely free arenas a descriptor keeps rather than
+   giving them back to the page allocator. */
+#define SPARE_ARENAS 2
+
+/* Free blocks cached in front of a descriptor. */
+struct magazine {
+  size_t cnt;                     /* Number of blocks held. */
+  struct block* blocks[MAG_SIZE]; /* Blocks, used as a stack. */
+};
+
 /* Descriptor. */
 struct desc {
   size_t block_size;       /* Size of each element in bytes. */
   size_t blocks_per_arena; /* Number of blocks in an arena. */
   struct list free_list;   /* List of free blocks. */
+  size_t spare_cnt;        /* Number of arenas with all blocks free. */
   struct lock lock;        /* Lock. */
+  struct magazine mag;     /* Free blocks to use without the lock. */
 };
 
 /* Magic number for detecting arena corruption. */
@@ -63,6 +93,10 @@ static size_t desc_cnt;       /* Number of descriptors. */
 
 static struct arena* block_to_arena(struct block*);
 static struct block* arena_to_block(struct arena*, size_t idx);
+static struct block* get_block(struct desc*);
+static void put_block(struct desc*, struct block*);
+static struct block* mag_pop(struct magazine*);
+static bool mag_push(struct magazine*, struct block*);
 
 /* Initializes the malloc() descriptors. */
 void malloc_init(void) {
@@ -74,7 +108,9 @@ void malloc_init(void) {
     d->block_size = block_size;
     d->blocks_per_arena = (PGSIZE - sizeof(struct arena)) / block_size;
     list_init(&d->free_list);
+    d->spare_cnt = 0;
     lock_init(&d->lock);
+    d->mag.cnt = 0;
   }
 }
 
@@ -110,33 +146,27 @@ void* malloc(size_t size) {
     return a + 1;
   }
 
+  /* Take a block from the magazine if it has one. */
+  b = mag_pop(&d->mag);
+  if (b != NULL)
+    return b;
+
   lock_acquire(&d->lock);
+  b = get_block(d);
 
-  /* If the free list is empty, create a new arena. */
-  if (list_empty(&d->free_list)) {
+  /* Reload half the magazine from blocks already on the free
+     list, so that the next few calls need no lock. */
+  if (b != NULL) {
     size_t i;
 
-    /* Allocate a page. */
-    a = palloc_get_page(0);
-    if (a == NULL) {
-      lock_release(&d->lock);
-      return NULL;
-    }
-
-    /* Initialize arena and add its blocks to the free list. */
-    a->magic = ARENA_MAGIC;
-    a->desc = d;
-    a->free_cnt = d->blocks_per_arena;
-    for (i = 0; i < d->blocks_per_arena; i++) {
-      struct block* b = arena_to_block(a, i);
-      list_push_back(&d->free_list, &b->free_elem);
+    for (i = 0; i < MAG_SIZE / 2 && !list_empty(&d->free_list); i++) {
+      struct block* extra = get_block(d);
+      if (!mag_push(&d->mag, extra)) {
+        put_block(d, extra);
+        break;
+      }
     }
   }
-
-  /* Get a block from free list and return it. */
-  b = list_entry(list_pop_front(&d->free_list), struct block, free_elem);
-  a = block_to_arena(b);
-  a->free_cnt--;
   lock_release(&d->lock);
   return b;
 }
@@ -207,23 +237,21 @@ void free(void* p) {
       memset(b, 0xcc, d->block_size);
 #endif
 
-      lock_acquire(&d->lock);
-
-      /* Add block to free list. */
-      list_push_front(&d->free_list, &b->free_elem);
+      /* Keep the block in the magazine if there is room. */
+      if (mag_push(&d->mag, b))
+        return;
 
-      /* If the arena is now entirely unused, free it. */
-      if (++a->free_cnt >= d->blocks_per_arena) {
-        size_t i;
-
-        ASSERT(a->free_cnt == d->blocks_per_arena);
-        for (i = 0; i < d->blocks_per_arena; i++) {
-          struct block* b = arena_to_block(a, i);
-          list_remove(&b->free_elem);
-        }
-        palloc_free_page(a);
+      /* The magazine is full.  Put half of it back on the free
+         list along with the block, so that the next few calls
+         need no lock either. */
+      lock_acquire(&d->lock);
+      put_block(d, b);
+      while (d->mag.cnt > MAG_SIZE / 2) {
+        struct block* extra = mag_pop(&d->mag);
+        if (extra == NULL)
+          break;
+        put_block(d, extra);
       }
-
       lock_release(&d->lock);
     } else {
       /* It's a big block.  Free its pages. */
@@ -233,6 +261,103 @@ void free(void* p) {
   }
 }
 
+/* Takes a block off descriptor D's free list, first creating a
+   new arena if the list is empty, and returns it.  Returns a
+   null pointer if memory is not available.  D's lock must be
+   held. */
+static struct block* get_block(struct desc* d) {
+  struct block* b;
+  struct arena* a;
+
+  ASSERT(lock_held_by_current_thread(&d->lock));
+
+  /* If the free list is empty, create a new arena. */
+  if (list_empty(&d->free_list)) {
+    size_t i;
+
+    /* Allocate a page. */
+    a = palloc_get_page(0);
+    if (a == NULL)
+      return NULL;
+
+    /* Initialize arena and add its blocks to the free list. */
+    a->magic = ARENA_MAGIC;
+    a->desc = d;
+    a->free_cnt = d->blocks_per_arena;
+    for (i = 0; i < d->blocks_per_arena; i++) {
+      struct block* b = arena_to_block(a, i);
+      list_push_back(&d->free_list, &b->free_elem);
+    }
+    d->spare_cnt++;
+  }
+
+  /* Get a block from free list. */
+  b = list_entry(list_pop_front(&d->free_list), struct block, free_elem);
+  a = block_to_arena(b);
+  if (a->free_cnt-- == d->blocks_per_arena)
+    d->spare_cnt--;
+  return b;
+}
+
+/* Puts block B back on descriptor D's free list.  If B's arena
+   is then entirely unused and D already has SPARE_ARENAS such
+   arenas, frees the arena.  D's lock must be held. */
+static void put_block(struct desc* d, struct block* b) {
+  struct arena* a = block_to_arena(b);
+
+  ASSERT(lock_held_by_current_thread(&d->lock));
+
+  /* Add block to free list. */
+  list_push_front(&d->free_list, &b->free_elem);
+
+  /* If the arena is now entirely unused, keep it as a spare or
+     free it. */
+  if (++a->free_cnt >= d->blocks_per_arena) {
+    size_t i;
+
+    ASSERT(a->free_cnt == d->blocks_per_arena);
+    if (d->spare_cnt < SPARE_ARENAS) {
+      d->spare_cnt++;
+      return;
+    }
+    for (i = 0; i < d->blocks_per_arena; i++) {
+      struct block* b = arena_to_block(a, i);
+      list_remove(&b->free_elem);
+    }
+    palloc_free_page(a);
+  }
+}
+
+/* Removes and returns a block from magazine M, or returns a null
+   pointer if M is empty.  Disabling interrupts is enough to keep
+   other threads out, since malloc() is never called from an
+   interrupt handler. */
+static struct block* mag_pop(struct magazine* m) {
+  struct block* b = NULL;
+  enum intr_level old_level = intr_disable();
+
+  if (m->cnt > 0)
+    b = m->blocks[--m->cnt];
+  intr_set_level(old_level);
+
+  return b;
+}
+
+/* Adds block B to magazine M.  Returns true if successful, false
+   if M is full. */
+static bool mag_push(struct magazine* m, struct block* b) {
+  bool pushed = false;
+  enum intr_level old_level = intr_disable();
+
+  if (m->cnt < MAG_SIZE) {
+    m->blocks[m->cnt++] = b;
+    pushed = true;
+  }
+  intr_set_level(old_level);
+
+  return pushed;
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena* block_to_arena(struct block* b) {
   struct arena* a = pg_round_down(b);
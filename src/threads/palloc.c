@@ -2,11 +2,13 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -23,13 +25,55 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is managed as a binary buddy system.  Free memory is
+   kept as blocks of 2**ORDER pages, for ORDER from 0 up to
+   MAX_ORDER - 1, each aligned to its own size in physical
+   memory, on one free list per order.  An allocation takes the
+   smallest block that is big enough, splitting larger ones as
+   needed, and gives back the unused tail of the block, so that
+   exactly the requested number of pages are allocated.  Freeing
+   pages merges each block with its "buddy," the other half of
+   the block of twice the size, for as long as the buddy is free
+   too.  Both take time proportional to the number of orders,
+   not to the size of the pool.
+
+   Each free block keeps its free list element in its first page.
+   A per-page array records, for the first page of each free
+   block, the block's order, so that the buddy of a block being
+   freed can be found and checked in constant time.  The bitmap
+   of used pages serves only to catch double frees.
+
+   The idle thread also zeroes free pages in the background,
+   through palloc_zero_idle(), and keeps up to ZEROED_MAX of them
+   on a list per pool, so that a single-page PAL_ZERO request can
+   usually skip the memset().  Pages on that list are out of the
+   buddy system.  If the buddy system cannot satisfy a request,
+   the list is given back to it and the request retried. */
+
+/* Number of block sizes, from 1 page to 2**(MAX_ORDER - 1)
+   pages. */
+#define MAX_ORDER 20
+
+/* Maximum number of pre-zeroed pages kept in each pool. */
+#define ZEROED_MAX 64
 
 /* A memory pool. */
 struct pool {
-  struct lock lock;        /* Mutual exclusion. */
-  struct bitmap* used_map; /* Bitmap of free pages. */
-  uint8_t* base;           /* Base of pool. */
+  struct lock lock;                  /* Mutual exclusion. */
+  struct bitmap* used_map;           /* Bitmap of free pages. */
+  uint8_t* base;                     /* Base of pool. */
+  size_t base_pfn;                   /* Physical page number of BASE. */
+  uint8_t* free_order;               /* Per page: 1 + order of free block it starts, or 0. */
+  struct list free_lists[MAX_ORDER]; /* Free blocks of each order. */
+
+  /* Pre-zeroed pages.  Protected by disabling interrupts, so that
+     the idle thread never has to wait for LOCK. */
+  struct list zeroed;                /* Zeroed free pages. */
+  size_t zeroed_cnt;                 /* Number of pages in ZEROED. */
+  unsigned long long zeroed_hits;    /* PAL_ZERO pages taken from ZEROED. */
+  unsigned long long zeroed_miss;    /* PAL_ZERO requests that had to memset(). */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -37,6 +81,11 @@ static struct pool kernel_pool, user_pool;
 
 static void init_pool(struct pool*, void* base, size_t page_cnt, const char* name);
 static bool page_from_pool(const struct pool*, void* page);
+static size_t buddy_alloc(struct pool*, size_t page_cnt, unsigned min_order);
+static void buddy_free(struct pool*, size_t page_idx, size_t page_cnt);
+static void* take_zeroed(struct pool*);
+static bool release_zeroed(struct pool*);
+static bool zero_page(struct pool*);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -63,15 +112,44 @@ void palloc_init(size_t user_page_limit) {
    available, returns a null pointer, unless PAL_ASSERT is set in
    FLAGS, in which case the kernel panics. */
 void* palloc_get_multiple(enum palloc_flags flags, size_t page_cnt) {
+  return palloc_get_aligned(flags, page_cnt, 1);
+}
+
+/* Like palloc_get_multiple(), but the run of PAGE_CNT pages
+   starts at a physical address that is a multiple of ALIGN
+   pages, as a large page requires.  ALIGN must be a power of
+   2. */
+void* palloc_get_aligned(enum palloc_flags flags, size_t page_cnt, size_t align) {
   struct pool* pool = flags & PAL_USER ? &user_pool : &kernel_pool;
   void* pages;
   size_t page_idx;
+  unsigned min_order = 0;
 
+  ASSERT(align > 0 && (align & (align - 1)) == 0);
   if (page_cnt == 0)
     return NULL;
+  while (((size_t)1 << min_order) < align)
+    min_order++;
 
   lock_acquire(&pool->lock);
-  page_idx = bitmap_scan_and_flip(pool->used_map, 0, page_cnt, false);
+
+  /* Use a pre-zeroed page if one is wanted and available. */
+  if ((flags & PAL_ZERO) && page_cnt == 1 && (pages = take_zeroed(pool)) != NULL) {
+    page_idx = pg_no(pages) - pg_no(pool->base);
+    bitmap_mark(pool->used_map, page_idx);
+    pool->zeroed_hits++;
+    lock_release(&pool->lock);
+    return pages;
+  }
+
+  page_idx = buddy_alloc(pool, page_cnt, min_order);
+  if (page_idx == BITMAP_ERROR && release_zeroed(pool))
+    page_idx = buddy_alloc(pool, page_cnt, min_order);
+  if (page_idx != BITMAP_ERROR) {
+    bitmap_set_multiple(pool->used_map, page_idx, page_cnt, true);
+    if (flags & PAL_ZERO)
+      pool->zeroed_miss++;
+  }
   lock_release(&pool->lock);
 
   if (page_idx != BITMAP_ERROR)
@@ -121,20 +199,40 @@ void palloc_free_multiple(void* pages, size_t page_cnt) {
   memset(pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  lock_acquire(&pool->lock);
   ASSERT(bitmap_all(pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple(pool->used_map, page_idx, page_cnt, false);
+  buddy_free(pool, page_idx, page_cnt);
+  lock_release(&pool->lock);
 }
 
 /* Frees the page at PAGE. */
 void palloc_free_page(void* page) { palloc_free_multiple(page, 1); }
 
+/* Zeroes one free page, if any pool is short of pre-zeroed pages
+   and not busy, for a later PAL_ZERO request to use.  Returns
+   true if it zeroed a page, false if there was nothing to do.
+   Called by the idle thread, so never blocks. */
+bool palloc_zero_idle(void) { return zero_page(&kernel_pool) || zero_page(&user_pool); }
+
+/* Prints pre-zeroed page statistics. */
+void palloc_print_stats(void) {
+  printf("Palloc: kernel pool %llu zeroed-page hits, %llu misses; "
+         "user pool %llu hits, %llu misses\n",
+         kernel_pool.zeroed_hits, kernel_pool.zeroed_miss, user_pool.zeroed_hits,
+         user_pool.zeroed_miss);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void init_pool(struct pool* p, void* base, size_t page_cnt, const char* name) {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP(bitmap_buf_size(page_cnt), PGSIZE);
+  /* We'll put the pool's used_map at its base, followed by the
+     free_order array.  Calculate the space needed for them and
+     subtract it from the pool's size. */
+  size_t bm_size = bitmap_buf_size(page_cnt);
+  size_t bm_pages = DIV_ROUND_UP(bm_size + page_cnt, PGSIZE);
+  size_t order;
+
   if (bm_pages > page_cnt)
     PANIC("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
@@ -143,8 +241,19 @@ static void init_pool(struct pool* p, void* base, size_t page_cnt, const char* n
 
   /* Initialize the pool. */
   lock_init(&p->lock);
-  p->used_map = bitmap_create_in_buf(page_cnt, base, bm_pages * PGSIZE);
+  p->used_map = bitmap_create_in_buf(page_cnt, base, bm_size);
+  p->free_order = (uint8_t*)base + bm_size;
+  memset(p->free_order, 0, page_cnt);
   p->base = base + bm_pages * PGSIZE;
+  p->base_pfn = vtop(p->base) >> PGBITS;
+  for (order = 0; order < MAX_ORDER; order++)
+    list_init(&p->free_lists[order]);
+  list_init(&p->zeroed);
+  p->zeroed_cnt = 0;
+  p->zeroed_hits = p->zeroed_miss = 0;
+
+  /* All of the pool starts out free. */
+  buddy_free(p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -156,3 +265,157 @@ static bool page_from_pool(const struct pool* pool, void* page) {
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the free list element in the first page of the block
+   at PAGE_IDX in POOL. */
+static struct list_elem* block_elem(struct pool* pool, size_t page_idx) {
+  return (struct list_elem*)(pool->base + PGSIZE * page_idx);
+}
+
+/* Returns the index in POOL of the block whose free list element
+   is E. */
+static size_t elem_block(struct pool* pool, struct list_elem* e) {
+  return ((uint8_t*)e - pool->base) / PGSIZE;
+}
+
+/* Puts the block of 2**ORDER pages at PAGE_IDX in POOL on its
+   free list, without merging it with its buddy. */
+static void push_block(struct pool* pool, size_t page_idx, unsigned order) {
+  pool->free_order[page_idx] = order + 1;
+  list_push_front(&pool->free_lists[order], block_elem(pool, page_idx));
+}
+
+/* Takes the free block at PAGE_IDX in POOL off its free list. */
+static void remove_block(struct pool* pool, size_t page_idx) {
+  pool->free_order[page_idx] = 0;
+  list_remove(block_elem(pool, page_idx));
+}
+
+/* Frees the block of 2**ORDER pages at PAGE_IDX in POOL, merging
+   it with its buddy, and the result with its own buddy, and so
+   on, for as long as the buddy is free. */
+static void free_block(struct pool* pool, size_t page_idx, unsigned order) {
+  size_t page_cnt = bitmap_size(pool->used_map);
+
+  for (; order + 1 < MAX_ORDER; order++) {
+    size_t buddy_pfn = (pool->base_pfn + page_idx) ^ ((size_t)1 << order);
+    size_t buddy_idx = buddy_pfn - pool->base_pfn;
+
+    if (buddy_pfn < pool->base_pfn || buddy_idx >= page_cnt ||
+        pool->free_order[buddy_idx] != order + 1)
+      break;
+    remove_block(pool, buddy_idx);
+    if (buddy_idx < page_idx)
+      page_idx = buddy_idx;
+  }
+  push_block(pool, page_idx, order);
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL, which
+   need not form a single block, by splitting them into the
+   largest aligned blocks possible. */
+static void buddy_free(struct pool* pool, size_t page_idx, size_t page_cnt) {
+  while (page_cnt > 0) {
+    size_t pfn = pool->base_pfn + page_idx;
+    unsigned order = 0;
+
+    while (order + 1 < MAX_ORDER && pfn % ((size_t)2 << order) == 0 &&
+           ((size_t)2 << order) <= page_cnt)
+      order++;
+    free_block(pool, page_idx, order);
+    page_idx += (size_t)1 << order;
+    page_cnt -= (size_t)1 << order;
+  }
+}
+
+/* Allocates PAGE_CNT pages from POOL, starting at a physical page
+   number that is a multiple of 2**MIN_ORDER, and returns the
+   index of the first one.  Returns BITMAP_ERROR if no block is
+   big enough. */
+static size_t buddy_alloc(struct pool* pool, size_t page_cnt, unsigned min_order) {
+  unsigned want = min_order;
+  unsigned order;
+  size_t page_idx;
+
+  while (want < MAX_ORDER && ((size_t)1 << want) < page_cnt)
+    want++;
+
+  /* Find the smallest free block that is big enough. */
+  for (order = want; order < MAX_ORDER; order++)
+    if (!list_empty(&pool->free_lists[order]))
+      break;
+  if (order >= MAX_ORDER)
+    return BITMAP_ERROR;
+  page_idx = elem_block(pool, list_front(&pool->free_lists[order]));
+  remove_block(pool, page_idx);
+
+  /* Split it down to the size wanted, freeing the upper halves. */
+  while (order > want) {
+    order--;
+    push_block(pool, page_idx + ((size_t)1 << order), order);
+  }
+
+  /* Give back the part of the block beyond PAGE_CNT. */
+  buddy_free(pool, page_idx + page_cnt, ((size_t)1 << want) - page_cnt);
+  return page_idx;
+}
+
+/* Removes and returns a page from POOL's list of pre-zeroed
+   pages, or returns a null pointer if the list is empty. */
+static void* take_zeroed(struct pool* pool) {
+  struct list_elem* e = NULL;
+  enum intr_level old_level = intr_disable();
+
+  if (!list_empty(&pool->zeroed)) {
+    e = list_pop_front(&pool->zeroed);
+    pool->zeroed_cnt--;
+  }
+  intr_set_level(old_level);
+
+  /* Clear the list element, the only part of the page that is
+     not zero. */
+  if (e != NULL)
+    memset(e, 0, sizeof *e);
+  return e;
+}
+
+/* Gives all of POOL's pre-zeroed pages back to its buddy system.
+   Returns true if there were any.  POOL's lock must be held. */
+static bool release_zeroed(struct pool* pool) {
+  bool released = false;
+  void* page;
+
+  ASSERT(lock_held_by_current_thread(&pool->lock));
+
+  while ((page = take_zeroed(pool)) != NULL) {
+    buddy_free(pool, pg_no(page) - pg_no(pool->base), 1);
+    released = true;
+  }
+  return released;
+}
+
+/* Takes a free page from POOL, zeroes it, and adds it to POOL's
+   list of pre-zeroed pages.  Returns true if successful, false
+   if the list is already full, POOL's lock is busy, or POOL has
+   no free pages. */
+static bool zero_page(struct pool* pool) {
+  enum intr_level old_level;
+  size_t page_idx;
+  struct list_elem* page;
+
+  if (pool->zeroed_cnt >= ZEROED_MAX || !lock_try_acquire(&pool->lock))
+    return false;
+  page_idx = buddy_alloc(pool, 1, 0);
+  lock_release(&pool->lock);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  page = (struct list_elem*)(pool->base + PGSIZE * page_idx);
+  memset(page, 0, PGSIZE);
+
+  old_level = intr_disable();
+  list_push_front(&pool->zeroed, page);
+  pool->zeroed_cnt++;
+  intr_set_level(old_level);
+  return true;
+}
@@ -28,6 +28,11 @@
 #define PDBITS 10                       /* Number of page dir bits. */
 #define PDMASK BITMASK(PDSHIFT, PDBITS) /* Page directory bits (22:31). */
 
+/* Large pages (bits 22:31 only), available with PSE. */
+#define LPGSIZE PTSPAN                /* Bytes in a large page (4 MB). */
+#define LPGPAGES (LPGSIZE / PGSIZE)   /* Pages in a large page. */
+#define LPGMASK BITMASK(0, PDSHIFT)   /* Large page offset bits (0:21). */
+
 /* Obtains page table index from a virtual address. */
 static inline unsigned pt_no(const void* va) { return ((uintptr_t)va & PTMASK) >> PTSHIFT; }
 
@@ -53,7 +58,13 @@ static inline uintptr_t pd_no(const void* va) { return (uintptr_t)va >> PDSHIFT;
    When a PDE or PTE is not "present", the other flags are
    ignored.
    A PDE or PTE that is initialized to 0 will be interpreted as
-   "not present", which is just fine. */
+   "not present", which is just fine.
+
+   A PDE with PTE_PS set maps a 4 MB large page directly instead
+   of pointing to a page table.  Its physical address must be 4
+   MB aligned, and the CPU honors it only once PSE is enabled in
+   CR4.  See [IA32-v3a] 3.7.3 "Mixing 4-KByte and 4-MByte
+   Pages". */
 #define PTE_FLAGS 0x00000fff /* Flag bits. */
 #define PTE_ADDR 0xfffff000  /* Address bits. */
 #define PTE_AVL 0x00000e00   /* Bits available for OS use. */
@@ -62,6 +73,7 @@ static inline uintptr_t pd_no(const void* va) { return (uintptr_t)va >> PDSHIFT;
 #define PTE_U 0x4            /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20           /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40           /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80          /* 1=4 MB page, 0=page table (PDEs only). */
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create(uint32_t* pt) {
@@ -73,9 +85,31 @@ static inline uint32_t pde_create(uint32_t* pt) {
    PDE, which must "present", points to. */
 static inline uint32_t* pde_get_pt(uint32_t pde) {
   ASSERT(pde & PTE_P);
+  ASSERT(!(pde & PTE_PS));
   return ptov(pde & PTE_ADDR);
 }
 
+/* Returns a PDE that maps large page PAGE, which must be 4 MB
+   aligned in physical memory.  It is readable, writable if
+   WRITABLE is true, and usable by user code if USER is true. */
+static inline uint32_t pde_create_large(void* page, bool writable, bool user) {
+  ASSERT((vtop(page) & LPGMASK) == 0);
+  return vtop(page) | PTE_PS | PTE_P | (writable ? PTE_W : 0) | (user ? PTE_U : 0);
+}
+
+/* Returns true if PDE, which must be present, maps a large
+   page. */
+static inline bool pde_is_large(uint32_t pde) {
+  ASSERT(pde & PTE_P);
+  return (pde & PTE_PS) != 0;
+}
+
+/* Returns a pointer to the large page that PDE maps. */
+static inline void* pde_get_large(uint32_t pde) {
+  ASSERT(pde_is_large(pde));
+  return ptov(pde & ~LPGMASK);
+}
+
 /* Returns a PTE that points to PAGE.
    The PTE's page is readable.
    If WRITABLE is true then it will be writable as well.
@@ -0,0 +1,101 @@
+#include "threads/sched-trace.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+
+/* Scheduler trace.
+
+   When the kernel is started with -sched-trace, every change in
+   a thread's scheduling state is recorded in a ring buffer, which
+   is printed when the machine powers off.  utils/sched-trace
+   turns the printout into run-queue latency histograms and
+   per-thread CPU times.
+
+   All the events are recorded with interrupts off, so on our
+   single CPU a record is never interrupted by another and the
+   ring needs no lock.  Once the ring is full, each new event
+   overwrites the oldest. */
+
+/* Number of pages in the ring. */
+#define TRACE_PAGES 16
+
+/* A recorded event. */
+struct trace_entry {
+  uint64_t tsc;     /* Time-stamp counter. */
+  int64_t tick;     /* Timer ticks since boot. */
+  uint8_t event;    /* A SCHED_* event. */
+  uint8_t priority; /* Thread's priority. */
+  int tid;          /* Thread. */
+  int other;        /* Other thread, or -1. */
+};
+
+/* True if events are being recorded. */
+bool sched_trace_enabled;
+
+static struct trace_entry* ring; /* Ring buffer. */
+static size_t ring_cnt;          /* Number of entries in ring. */
+static size_t ring_head;         /* Next entry to overwrite. */
+static unsigned long long recorded_cnt; /* Number of events recorded. */
+
+static const char* event_names[] = {"enqueue", "dequeue", "switch", "block", "unblock"};
+
+/* Allocates the ring buffer and starts recording events. */
+void sched_trace_init(void) {
+  ring = palloc_get_multiple(PAL_ASSERT, TRACE_PAGES);
+  ring_cnt = TRACE_PAGES * PGSIZE / sizeof *ring;
+  sched_trace_enabled = true;
+}
+
+/* Records EVENT for thread T, involving thread OTHER, which may
+   be null.  Use sched_trace() instead of calling this directly. */
+void sched_trace_record(enum sched_event event, const struct thread* t,
+                        const struct thread* other) {
+  struct trace_entry* e;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  e = &ring[ring_head];
+  if (++ring_head == ring_cnt)
+    ring_head = 0;
+  recorded_cnt++;
+
+  e->tsc = rdtsc();
+  e->tick = timer_ticks();
+  e->event = event;
+  e->priority = t->priority;
+  e->tid = t->tid;
+  e->other = other != NULL ? other->tid : -1;
+}
+
+/* Prints the name of thread T in the trace. */
+static void dump_thread(struct thread* t, void* aux UNUSED) {
+  printf("sched-trace: thread %d %s\n", t->tid, t->name);
+}
+
+/* Prints the events in the ring, oldest first, along with the
+   names of the threads that still exist. */
+void sched_trace_dump(void) {
+  enum intr_level old_level;
+  size_t cnt, i;
+
+  if (!sched_trace_enabled)
+    return;
+
+  old_level = intr_disable();
+  sched_trace_enabled = false;
+  cnt = recorded_cnt < ring_cnt ? recorded_cnt : ring_cnt;
+  printf("sched-trace: %llu events, %llu lost\n", recorded_cnt, recorded_cnt - cnt);
+  thread_foreach(dump_thread, NULL);
+  for (i = 0; i < cnt; i++) {
+    const struct trace_entry* e = &ring[(ring_head + ring_cnt - cnt + i) % ring_cnt];
+    printf("sched-trace: %llu %lld %s %d %d %d\n", e->tsc, e->tick, event_names[e->event],
+           e->tid, e->other, e->priority);
+  }
+  intr_set_level(old_level);
+}
@@ -0,0 +1,32 @@
+#ifndef THREADS_SCHED_TRACE_H
+#define THREADS_SCHED_TRACE_H
+
+#include <stdbool.h>
+
+struct thread;
+
+/* Scheduler events. */
+enum sched_event {
+  SCHED_ENQUEUE, /* Thread added to the run queue. */
+  SCHED_DEQUEUE, /* Thread chosen to run next. */
+  SCHED_SWITCH,  /* Thread now running, after the other one. */
+  SCHED_BLOCK,   /* Thread went to sleep. */
+  SCHED_UNBLOCK  /* Thread woken up by the other one. */
+};
+
+extern bool sched_trace_enabled;
+
+void sched_trace_init(void);
+void sched_trace_record(enum sched_event, const struct thread*, const struct thread* other);
+void sched_trace_dump(void);
+
+/* Records EVENT for thread T, involving thread OTHER, which may
+   be null, if tracing is enabled.  Must be called with
+   interrupts off. */
+static inline void sched_trace(enum sched_event event, const struct thread* t,
+                               const struct thread* other) {
+  if (sched_trace_enabled)
+    sched_trace_record(event, t, other);
+}
+
+#endif /* threads/sched-trace.h */
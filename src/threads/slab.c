@@ -0,0 +1,217 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Object caches.
+
+   malloc() rounds every request up to a power of two, so a
+   12-byte object takes 16 bytes and a 72-byte one takes 128.  A
+   kmem_cache instead hands out objects of exactly one size,
+   packed into page-size "slabs" taken from the page allocator.
+
+   A cache may also have a constructor, which sets up each object
+   once, when its slab is created.  An object handed back to
+   kmem_cache_free() must be in its constructed state again (for
+   example, its locks released and its lists empty), so the next
+   kmem_cache_alloc() can skip that work.  To make that possible,
+   free objects are never written to: each slab keeps the indexes
+   of its free objects in an array of its own, right after the
+   slab header:
+
+        +-------------+------------------+-----+-----+-----+--
+        | struct slab | free index stack | obj | obj | obj | ...
+        +-------------+------------------+-----+-----+-----+--
+
+   A cache keeps the slabs that have any free objects on a list.
+   A slab whose objects are all in use drops off the list, and
+   goes back on when one of them is freed.  A slab with no objects
+   in use is given back to the page allocator, except that each
+   cache keeps one such slab around so that allocating and
+   freeing a single object does not get and free a page each
+   time. */
+
+/* Objects are aligned to this many bytes. */
+#define SLAB_ALIGN sizeof(void*)
+
+/* Magic number for detecting corruption. */
+#define SLAB_MAGIC 0x5ab1ca5e
+
+/* A slab, at the start of a page. */
+struct slab {
+  unsigned magic;           /* Always set to SLAB_MAGIC. */
+  struct kmem_cache* cache; /* Owning cache. */
+  struct list_elem elem;    /* Element in cache's list of slabs. */
+  size_t free_cnt;          /* Number of free objects. */
+  uint16_t free[];          /* Indexes of free objects, as a stack. */
+};
+
+/* List of all caches, for slab_print_stats(). */
+static struct list all_caches = LIST_INITIALIZER(all_caches);
+
+static struct slab* slab_create(struct kmem_cache*);
+static struct slab* obj_to_slab(struct kmem_cache*, void* obj);
+
+/* Initializes cache C to hand out objects of SIZE bytes, giving
+   them the name NAME in statistics.  If CTOR is non-null, each
+   object is passed to it once, when its slab is created. */
+void kmem_cache_init(struct kmem_cache* c, const char* name, size_t size, kmem_ctor_func* ctor) {
+  size_t n;
+  enum intr_level old_level;
+
+  ASSERT(c != NULL);
+  ASSERT(size > 0 && size <= PGSIZE / 8);
+
+  c->name = name;
+  c->obj_size = ROUND_UP(size, SLAB_ALIGN);
+  c->ctor = ctor;
+
+  /* Fit as many objects, with their free list entries, as a
+     page will hold. */
+  n = (PGSIZE - sizeof(struct slab)) / (c->obj_size + sizeof(uint16_t));
+  while (ROUND_UP(sizeof(struct slab) + n * sizeof(uint16_t), SLAB_ALIGN) + n * c->obj_size >
+         PGSIZE)
+    n--;
+  c->objs_per_slab = n;
+  c->obj_ofs = ROUND_UP(sizeof(struct slab) + n * sizeof(uint16_t), SLAB_ALIGN);
+
+  lock_init(&c->lock);
+  list_init(&c->slabs);
+  c->empty_cnt = 0;
+  c->slab_cnt = 0;
+  c->in_use = 0;
+  c->peak_in_use = 0;
+  c->alloc_cnt = 0;
+
+  old_level = intr_disable();
+  list_push_back(&all_caches, &c->elem);
+  intr_set_level(old_level);
+}
+
+/* Allocates and returns an object from cache C, in the state its
+   constructor left it, or as the last kmem_cache_free() left it.
+   Returns a null pointer if memory is not available. */
+void* kmem_cache_alloc(struct kmem_cache* c) {
+  struct slab* s;
+  size_t idx;
+
+  lock_acquire(&c->lock);
+  if (list_empty(&c->slabs)) {
+    s = slab_create(c);
+    if (s == NULL) {
+      lock_release(&c->lock);
+      return NULL;
+    }
+  } else
+    s = list_entry(list_front(&c->slabs), struct slab, elem);
+
+  /* Take an object from the slab.  A slab with none left leaves
+     the list until one is freed. */
+  if (s->free_cnt == c->objs_per_slab)
+    c->empty_cnt--;
+  idx = s->free[--s->free_cnt];
+  if (s->free_cnt == 0)
+    list_remove(&s->elem);
+
+  c->alloc_cnt++;
+  if (++c->in_use > c->peak_in_use)
+    c->peak_in_use = c->in_use;
+  lock_release(&c->lock);
+
+  return (uint8_t*)s + c->obj_ofs + idx * c->obj_size;
+}
+
+/* Returns OBJ, which must have come from kmem_cache_alloc() on
+   cache C, to C.  OBJ must be back in its constructed state.
+   Does nothing if OBJ is null. */
+void kmem_cache_free(struct kmem_cache* c, void* obj) {
+  struct slab* s;
+
+  if (obj == NULL)
+    return;
+
+  s = obj_to_slab(c, obj);
+  lock_acquire(&c->lock);
+  ASSERT(s->free_cnt < c->objs_per_slab);
+  if (s->free_cnt == 0)
+    list_push_front(&c->slabs, &s->elem);
+  s->free[s->free_cnt++] = ((uint8_t*)obj - ((uint8_t*)s + c->obj_ofs)) / c->obj_size;
+  c->in_use--;
+
+  /* Give back a slab that is now unused, unless it is the only
+     one the cache would have left. */
+  if (s->free_cnt == c->objs_per_slab) {
+    if (c->empty_cnt == 0)
+      c->empty_cnt++;
+    else {
+      list_remove(&s->elem);
+      s->magic = 0;
+      c->slab_cnt--;
+      palloc_free_page(s);
+    }
+  }
+  lock_release(&c->lock);
+}
+
+/* Prints statistics for each object cache. */
+void slab_print_stats(void) {
+  struct list_elem* e;
+
+  for (e = list_begin(&all_caches); e != list_end(&all_caches); e = list_next(e)) {
+    struct kmem_cache* c = list_entry(e, struct kmem_cache, elem);
+    printf("Slab %s: %zu-byte objects, %zu in use (peak %zu), %zu slabs, %llu allocations\n",
+           c->name, c->obj_size, c->in_use, c->peak_in_use, c->slab_cnt, c->alloc_cnt);
+  }
+}
+
+/* Creates a new slab for cache C, runs C's constructor on each of
+   its objects, and adds it to C's list of slabs.  Returns the new
+   slab, or a null pointer if memory is not available.  C's lock
+   must be held. */
+static struct slab* slab_create(struct kmem_cache* c) {
+  struct slab* s;
+  size_t i;
+
+  ASSERT(lock_held_by_current_thread(&c->lock));
+
+  s = palloc_get_page(0);
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->free_cnt = c->objs_per_slab;
+
+  /* Stack the indexes so that the lowest-addressed object is
+     handed out first. */
+  for (i = 0; i < c->objs_per_slab; i++) {
+    s->free[i] = c->objs_per_slab - 1 - i;
+    if (c->ctor != NULL)
+      c->ctor((uint8_t*)s + c->obj_ofs + i * c->obj_size);
+  }
+
+  list_push_front(&c->slabs, &s->elem);
+  c->empty_cnt++;
+  c->slab_cnt++;
+  return s;
+}
+
+/* Returns the slab that object OBJ, from cache C, is inside. */
+static struct slab* obj_to_slab(struct kmem_cache* c, void* obj) {
+  struct slab* s = pg_round_down(obj);
+
+  /* Check that the slab is valid. */
+  ASSERT(s != NULL);
+  ASSERT(s->magic == SLAB_MAGIC);
+  ASSERT(s->cache == c);
+
+  /* Check that OBJ is properly aligned on an object boundary. */
+  ASSERT(pg_ofs(obj) >= c->obj_ofs);
+  ASSERT((pg_ofs(obj) - c->obj_ofs) % c->obj_size == 0);
+
+  return s;
+}
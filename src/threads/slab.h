@@ -0,0 +1,36 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Initializes a newly created object OBJ.  Called once per
+   object when its slab is created, not on every allocation. */
+typedef void kmem_ctor_func(void* obj);
+
+/* A cache of objects of a single size.  See slab.c. */
+struct kmem_cache {
+  const char* name;      /* Name, for statistics. */
+  size_t obj_size;       /* Size of each object, rounded up. */
+  size_t objs_per_slab;  /* Number of objects in each slab. */
+  size_t obj_ofs;        /* Offset of first object in a slab. */
+  kmem_ctor_func* ctor;  /* Constructor, or a null pointer. */
+  struct lock lock;      /* Protects everything below. */
+  struct list slabs;     /* Slabs with at least one free object. */
+  size_t empty_cnt;      /* Number of slabs with no objects in use. */
+  struct list_elem elem; /* Element in list of all caches. */
+
+  /* Statistics. */
+  size_t slab_cnt;              /* Number of slabs. */
+  size_t in_use;                /* Objects currently allocated. */
+  size_t peak_in_use;           /* Most objects ever allocated at once. */
+  unsigned long long alloc_cnt; /* Number of kmem_cache_alloc() calls. */
+};
+
+void kmem_cache_init(struct kmem_cache*, const char* name, size_t size, kmem_ctor_func*);
+void* kmem_cache_alloc(struct kmem_cache*) __attribute__((malloc));
+void kmem_cache_free(struct kmem_cache*, void*);
+void slab_print_stats(void);
+
+#endif /* threads/slab.h */
@@ -27,10 +27,48 @@
 */
 
 #include "threads/synch.h"
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* Contention statistics for the locks initialized with
+   lock_init_named() under one name.  Every process's fd_lock,
+   for example, shares one set. */
+struct lock_stats {
+  const char* name;        /* Name of the locks. */
+  long long acquire_cnt;   /* Number of acquisitions. */
+  long long contended_cnt; /* Acquisitions that had to wait. */
+  int64_t wait_ticks;      /* Timer ticks spent waiting. */
+  uint64_t max_hold;       /* Longest hold, in TSC cycles. */
+};
+
+/* All the named locks' statistics, in order of first use.
+   Protected by disabling interrupts. */
+#define LOCK_STATS_CNT 32
+static struct lock_stats lock_stats[LOCK_STATS_CNT];
+static size_t lock_stats_cnt;
+
+static void lock_take(struct lock*, struct thread*);
+
+/* The current RCU grace period, which ends at the next context
+   switch (see rcu_read_lock()), and the call_rcu() callbacks
+   waiting for their grace periods to end, oldest first.
+   Protected by disabling interrupts. */
+static unsigned rcu_gp;
+static struct list rcu_callbacks = LIST_INITIALIZER(rcu_callbacks);
+
+/* Kernel thread that runs call_rcu() callbacks, and whether it
+   is blocked waiting for a grace period to end.  Protected by
+   disabling interrupts. */
+static struct thread* rcu_thread;
+static bool rcu_sleeping;
+
+static bool rcu_callback_ready(void);
+static thread_func rcu_worker NO_RETURN;
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -93,19 +131,33 @@ bool sema_try_down(struct semaphore* sema) {
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up one of the threads waiting for SEMA, if any: the
+   highest-priority one under the priority and MLFQS schedulers,
+   which preempts the running thread if it has a higher priority
+   (see thread_preempt()), and otherwise the one that has waited
+   longest.
 
    This function may be called from an interrupt handler. */
 void sema_up(struct semaphore* sema) {
   enum intr_level old_level;
+  bool woken = false;
 
   ASSERT(sema != NULL);
 
   old_level = intr_disable();
-  if (!list_empty(&sema->waiters))
-    thread_unblock(list_entry(list_pop_front(&sema->waiters), struct thread, elem));
+  if (!list_empty(&sema->waiters)) {
+    struct list_elem* e = thread_priority_scheduling()
+                              ? list_max(&sema->waiters, thread_priority_less, NULL)
+                              : list_front(&sema->waiters);
+    list_remove(e);
+    thread_unblock(list_entry(e, struct thread, elem));
+    woken = true;
+  }
   sema->value++;
   intr_set_level(old_level);
+
+  if (woken)
+    thread_preempt();
 }
 
 static void sema_test_helper(void* sema_);
@@ -159,23 +211,73 @@ void lock_init(struct lock* lock) {
 
   lock->holder = NULL;
   sema_init(&lock->semaphore, 1);
+  lock->stats = NULL;
+  lock->acquired_at = 0;
+}
+
+/* Initializes LOCK like lock_init(), and also keeps contention
+   statistics for it, which lock_print_stats() prints.  Locks
+   given the same NAME share statistics.  NAME must remain valid
+   forever; a string literal is best. */
+void lock_init_named(struct lock* lock, const char* name) {
+  enum intr_level old_level;
+  size_t i;
+
+  ASSERT(name != NULL);
+
+  lock_init(lock);
+  old_level = intr_disable();
+  for (i = 0; i < lock_stats_cnt; i++)
+    if (!strcmp(lock_stats[i].name, name))
+      break;
+  if (i == lock_stats_cnt && lock_stats_cnt < LOCK_STATS_CNT)
+    lock_stats[lock_stats_cnt++].name = name;
+  if (i < lock_stats_cnt)
+    lock->stats = &lock_stats[i];
+  intr_set_level(old_level);
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   While the current thread waits, it donates its priority to the
+   holder of LOCK (see thread_donate_priority()).
+
+   An uncontended acquisition takes the lock directly, without
+   going through sema_down().  A contended one blocks at once
+   rather than spinning: with a single CPU, the holder cannot
+   make progress toward releasing the lock while we spin.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
    we need to sleep. */
 void lock_acquire(struct lock* lock) {
+  struct thread* cur = thread_current();
+  enum intr_level old_level;
+
   ASSERT(lock != NULL);
   ASSERT(!intr_context());
   ASSERT(!lock_held_by_current_thread(lock));
 
-  sema_down(&lock->semaphore);
-  lock->holder = thread_current();
+  old_level = intr_disable();
+  if (lock->semaphore.value > 0)
+    lock->semaphore.value--;
+  else {
+    int64_t start = timer_ticks();
+
+    cur->waiting_lock = lock;
+    thread_donate_priority(cur);
+    sema_down(&lock->semaphore);
+    cur->waiting_lock = NULL;
+    if (lock->stats != NULL) {
+      lock->stats->contended_cnt++;
+      lock->stats->wait_ticks += timer_ticks() - start;
+    }
+  }
+  lock_take(lock, cur);
+  intr_set_level(old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -185,28 +287,65 @@ void lock_acquire(struct lock* lock) {
    This function will not sleep, so it may be called within an
    interrupt handler. */
 bool lock_try_acquire(struct lock* lock) {
+  enum intr_level old_level;
   bool success;
 
   ASSERT(lock != NULL);
   ASSERT(!lock_held_by_current_thread(lock));
 
-  success = sema_try_down(&lock->semaphore);
-  if (success)
-    lock->holder = thread_current();
+  old_level = intr_disable();
+  success = lock->semaphore.value > 0;
+  if (success) {
+    lock->semaphore.value--;
+    lock_take(lock, thread_current());
+  }
+  intr_set_level(old_level);
   return success;
 }
 
+/* Makes CUR the holder of LOCK, which it has just acquired.
+   Interrupts must be off. */
+static void lock_take(struct lock* lock, struct thread* cur) {
+  lock->holder = cur;
+  list_push_back(&cur->held_locks, &lock->elem);
+  if (lock->stats != NULL) {
+    lock->stats->acquire_cnt++;
+    lock->acquired_at = rdtsc();
+  }
+}
+
 /* Releases LOCK, which must be owned by the current thread.
+   The current thread gives up any priority donated to it by
+   LOCK's waiters, and yields if one of them now has a higher
+   priority.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
    handler. */
 void lock_release(struct lock* lock) {
+  enum intr_level old_level;
+
   ASSERT(lock != NULL);
   ASSERT(lock_held_by_current_thread(lock));
 
+  old_level = intr_disable();
+  if (lock->stats != NULL) {
+    uint64_t held = rdtsc() - lock->acquired_at;
+    if (held > lock->stats->max_hold)
+      lock->stats->max_hold = held;
+  }
   lock->holder = NULL;
-  sema_up(&lock->semaphore);
+  list_remove(&lock->elem);
+  thread_update_priority(thread_current());
+
+  /* With no waiters there is no one to wake. */
+  if (list_empty(&lock->semaphore.waiters)) {
+    lock->semaphore.value++;
+    intr_set_level(old_level);
+  } else {
+    intr_set_level(old_level);
+    sema_up(&lock->semaphore);
+  }
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -218,6 +357,20 @@ bool lock_held_by_current_thread(const struct lock* lock) {
   return lock->holder == thread_current();
 }
 
+/* Prints contention statistics for the named locks that have
+   been acquired. */
+void lock_print_stats(void) {
+  size_t i;
+
+  for (i = 0; i < lock_stats_cnt; i++) {
+    struct lock_stats* ls = &lock_stats[i];
+    if (ls->acquire_cnt > 0)
+      printf("Lock %s: %lld acquisitions, %lld contended, %" PRId64
+             " ticks waiting, %" PRIu64 " cycles longest hold\n",
+             ls->name, ls->acquire_cnt, ls->contended_cnt, ls->wait_ticks, ls->max_hold);
+  }
+}
+
 /* Initializes a readers-writers lock */
 void rw_lock_init(struct rw_lock* rw_lock) {
   lock_init(&rw_lock->lock);
@@ -280,8 +433,19 @@ void rw_lock_release(struct rw_lock* rw_lock, bool reader) {
 struct semaphore_elem {
   struct list_elem elem;      /* List element. */
   struct semaphore semaphore; /* This semaphore. */
+  struct thread* thread;      /* Thread waiting on the semaphore. */
 };
 
+/* Orders semaphore_elems by ascending priority of their waiting
+   threads. */
+static bool waiter_priority_less(const struct list_elem* a_, const struct list_elem* b_,
+                                 void* aux UNUSED) {
+  const struct semaphore_elem* a = list_entry(a_, struct semaphore_elem, elem);
+  const struct semaphore_elem* b = list_entry(b_, struct semaphore_elem, elem);
+
+  return a->thread->priority < b->thread->priority;
+}
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -320,6 +484,7 @@ void cond_wait(struct condition* cond, struct lock* lock) {
   ASSERT(lock_held_by_current_thread(lock));
 
   sema_init(&waiter.semaphore, 0);
+  waiter.thread = thread_current();
   list_push_back(&cond->waiters, &waiter.elem);
   lock_release(lock);
   sema_down(&waiter.semaphore);
@@ -327,7 +492,9 @@ void cond_wait(struct condition* cond, struct lock* lock) {
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
+   this function signals one of them to wake up from its wait:
+   the highest-priority one under the priority and MLFQS
+   schedulers, otherwise the one that has waited longest.
    LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -339,8 +506,13 @@ void cond_signal(struct condition* cond, struct lock* lock UNUSED) {
   ASSERT(!intr_context());
   ASSERT(lock_held_by_current_thread(lock));
 
-  if (!list_empty(&cond->waiters))
-    sema_up(&list_entry(list_pop_front(&cond->waiters), struct semaphore_elem, elem)->semaphore);
+  if (!list_empty(&cond->waiters)) {
+    struct list_elem* e = thread_priority_scheduling()
+                              ? list_max(&cond->waiters, waiter_priority_less, NULL)
+                              : list_front(&cond->waiters);
+    list_remove(e);
+    sema_up(&list_entry(e, struct semaphore_elem, elem)->semaphore);
+  }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -356,3 +528,196 @@ void cond_broadcast(struct condition* cond, struct lock* lock) {
   while (!list_empty(&cond->waiters))
     cond_signal(cond, lock);
 }
+
+/* Initializes SEQLOCK. */
+void seqlock_init(struct seqlock* seqlock) {
+  ASSERT(seqlock != NULL);
+
+  seqlock->seq = 0;
+}
+
+/* Begins reading data protected by SEQLOCK and returns a value
+   to pass to seqlock_read_retry() once the data has been read. */
+unsigned seqlock_read_begin(const struct seqlock* seqlock) {
+  unsigned seq;
+
+  do {
+    seq = *(volatile const unsigned*)&seqlock->seq;
+    barrier();
+  } while (seq & 1);
+  return seq;
+}
+
+/* Returns true if a write to the data protected by SEQLOCK
+   overlapped the read begun by the seqlock_read_begin() call
+   that returned SEQ, in which case the data read must be
+   discarded and read again. */
+bool seqlock_read_retry(const struct seqlock* seqlock, unsigned seq) {
+  barrier();
+  return *(volatile const unsigned*)&seqlock->seq != seq;
+}
+
+/* Begins writing the data protected by SEQLOCK.  Interrupts must
+   be off until the matching seqlock_write_end(). */
+void seqlock_write_begin(struct seqlock* seqlock) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(!(seqlock->seq & 1));
+
+  seqlock->seq++;
+  barrier();
+}
+
+/* Ends writing the data protected by SEQLOCK. */
+void seqlock_write_end(struct seqlock* seqlock) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(seqlock->seq & 1);
+
+  barrier();
+  seqlock->seq++;
+}
+
+/* Begins an RCU read-side critical section, in which the
+   running thread may traverse a list forward without taking the
+   lock of its writers, which change it only with
+   rcu_list_push_front(), rcu_list_push_back(), and
+   rcu_list_remove(), and free removed elements with call_rcu().
+   Sections nest.
+
+   The thread must not sleep within the section, and it is not
+   preempted there either: a preemption requested meanwhile
+   happens in rcu_read_unlock() instead.  With a single CPU, no
+   context switch thus occurs within any section, so once one
+   has occurred after an element was removed, no thread can
+   still be looking at that element. */
+void rcu_read_lock(void) {
+  thread_current()->rcu_depth++;
+  barrier();
+}
+
+/* Ends an RCU read-side critical section, yielding the CPU if
+   the thread was to have been preempted within it. */
+void rcu_read_unlock(void) {
+  struct thread* cur = thread_current();
+
+  ASSERT(cur->rcu_depth > 0);
+
+  barrier();
+  if (--cur->rcu_depth == 0 && cur->rcu_yield) {
+    cur->rcu_yield = false;
+    if (!intr_context())
+      thread_yield();
+  }
+}
+
+/* Arranges for FUNC to be called with HEAD once no RCU reader
+   can still see the object that contains HEAD, that is, after
+   the next context switch.  The callback runs in the "rcu"
+   kernel thread, so it may sleep, as kmem_cache_free() and
+   free() can. */
+void call_rcu(struct rcu_head* head, rcu_func* func) {
+  enum intr_level old_level;
+
+  old_level = intr_disable();
+  head->gp = rcu_gp;
+  head->func = func;
+  list_push_back(&rcu_callbacks, &head->elem);
+  intr_set_level(old_level);
+}
+
+/* Inserts ELEM at the front of LIST, an RCU-protected list.
+   The caller must hold the lock that serializes the list's
+   writers.
+
+   Interrupts are off during the update, so no reader can run in
+   the middle of it.  Otherwise, a reader that preempted the
+   writer would depend on the order in which list_insert()
+   stores its pointers. */
+void rcu_list_push_front(struct list* list, struct list_elem* elem) {
+  enum intr_level old_level = intr_disable();
+  list_push_front(list, elem);
+  intr_set_level(old_level);
+}
+
+/* Inserts ELEM at the back of LIST, an RCU-protected list, like
+   rcu_list_push_front(). */
+void rcu_list_push_back(struct list* list, struct list_elem* elem) {
+  enum intr_level old_level = intr_disable();
+  list_push_back(list, elem);
+  intr_set_level(old_level);
+}
+
+/* Removes ELEM from its RCU-protected list, like
+   rcu_list_push_front().  ELEM's own links are left intact, so
+   a reader standing on it can still move on to the next
+   element. */
+void rcu_list_remove(struct list_elem* elem) {
+  enum intr_level old_level = intr_disable();
+  list_remove(elem);
+  intr_set_level(old_level);
+}
+
+/* Starts the kernel thread that runs call_rcu() callbacks.
+   Until it starts, callbacks just wait. */
+void rcu_init(void) {
+  struct semaphore started;
+
+  sema_init(&started, 0);
+  thread_create("rcu", PRI_DEFAULT, rcu_worker, &started);
+  sema_down(&started);
+}
+
+/* Returns true if the oldest queued callback's grace period has
+   ended.  Interrupts must be off. */
+static bool rcu_callback_ready(void) {
+  return (!list_empty(&rcu_callbacks) &&
+          list_entry(list_front(&rcu_callbacks), struct rcu_head, elem)->gp != rcu_gp);
+}
+
+/* Thread function for the "rcu" thread: runs each callback once
+   its grace period has ended, and otherwise sleeps until
+   rcu_quiescent() wakes it. */
+static void rcu_worker(void* started) {
+  rcu_thread = thread_current();
+  sema_up(started);
+
+  for (;;) {
+    struct rcu_head* done;
+    enum intr_level old_level = intr_disable();
+
+    while (!rcu_callback_ready()) {
+      rcu_sleeping = true;
+      thread_block();
+    }
+    done = list_entry(list_pop_front(&rcu_callbacks), struct rcu_head, elem);
+    intr_set_level(old_level);
+
+    done->func(done);
+  }
+}
+
+/* Called by intr_handler() before it preempts the running
+   thread.  Returns true if the thread may be preempted.  If it
+   is within an RCU read-side critical section, instead returns
+   false and has rcu_read_unlock() yield. */
+bool rcu_preemptible(void) {
+  struct thread* cur = thread_current();
+
+  if (cur->rcu_depth == 0)
+    return true;
+  cur->rcu_yield = true;
+  return false;
+}
+
+/* Called by thread_switch_tail() on each context switch, which
+   ends the current RCU grace period, once the new thread is
+   running.  Wakes the "rcu" thread if callbacks are now ready.
+   Interrupts must be off. */
+void rcu_quiescent(void) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  rcu_gp++;
+  if (rcu_sleeping && rcu_callback_ready()) {
+    rcu_sleeping = false;
+    thread_unblock(rcu_thread);
+  }
+}
@@ -3,6 +3,7 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* A counting semaphore. */
 struct semaphore {
@@ -20,13 +21,18 @@ void sema_self_test(void);
 struct lock {
   struct thread* holder;      /* Thread holding lock (for debugging). */
   struct semaphore semaphore; /* Binary semaphore controlling access. */
+  struct list_elem elem;      /* Element in holder's list of held locks. */
+  struct lock_stats* stats;   /* Contention statistics, or null. */
+  uint64_t acquired_at;       /* TSC when acquired, if STATS. */
 };
 
 void lock_init(struct lock*);
+void lock_init_named(struct lock*, const char* name);
 void lock_acquire(struct lock*);
 bool lock_try_acquire(struct lock*);
 void lock_release(struct lock*);
 bool lock_held_by_current_thread(const struct lock*);
+void lock_print_stats(void);
 
 /* Condition variable. */
 struct condition {
@@ -52,6 +58,47 @@ void rw_lock_init(struct rw_lock*);
 void rw_lock_acquire(struct rw_lock*, bool reader);
 void rw_lock_release(struct rw_lock*, bool reader);
 
+/* Sequence lock, for small data read far more often than it is
+   written.  Readers never block a writer: they retry if a write
+   overlapped their read.  Writers must keep interrupts off
+   while they write, so that a reader never waits for one. */
+struct seqlock {
+  unsigned seq; /* Odd while a write is in progress. */
+};
+
+void seqlock_init(struct seqlock*);
+unsigned seqlock_read_begin(const struct seqlock*);
+bool seqlock_read_retry(const struct seqlock*, unsigned seq);
+void seqlock_write_begin(struct seqlock*);
+void seqlock_write_end(struct seqlock*);
+
+/* Read-copy-update. */
+struct rcu_head;
+typedef void rcu_func(struct rcu_head*);
+
+/* Storage for a deferred call_rcu() callback, embedded in the
+   object that the callback frees. */
+struct rcu_head {
+  struct list_elem elem; /* Element in the callback list. */
+  unsigned gp;           /* Grace period during which it was queued. */
+  rcu_func* func;        /* Callback. */
+};
+
+/* Converts pointer to rcu_head RCU_HEAD into a pointer to the
+   structure that RCU_HEAD is embedded inside, as list_entry()
+   does for list elements. */
+#define rcu_entry(RCU_HEAD, STRUCT, MEMBER) list_entry(&(RCU_HEAD)->elem, STRUCT, MEMBER.elem)
+
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+void call_rcu(struct rcu_head*, rcu_func*);
+void rcu_list_push_front(struct list*, struct list_elem*);
+void rcu_list_push_back(struct list*, struct list_elem*);
+void rcu_list_remove(struct list_elem*);
+void rcu_init(void);
+bool rcu_preemptible(void);
+void rcu_quiescent(void);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
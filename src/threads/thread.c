@@ -8,9 +8,12 @@
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/sched-trace.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/tsc.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -24,6 +27,38 @@
    that are ready to run but not actually running. */
 static struct list fifo_ready_list;
 
+/* Ready queues for the strict-priority and MLFQS schedulers,
+   one per priority, and a bitmap whose bit P is set when
+   prio_ready_lists[P] is nonempty.  The highest ready priority
+   is then the index of the bitmap's most significant set bit. */
+static struct list prio_ready_lists[PRI_MAX + 1];
+static uint64_t prio_ready_bitmap;
+static int prio_ready_cnt; /* Number of threads in the queues. */
+
+/* MLFQS state.  A thread's priority depends only on its nice
+   value and recent_cpu, and between the once-per-second decays
+   recent_cpu changes only for threads that are charged a tick.
+   Those threads are collected on mlfqs_ran_list, so the priority
+   update every fourth tick need not visit any others. */
+static fixed_point_t load_avg;
+static struct list mlfqs_ran_list;
+#define NICE_MIN -20 /* Lowest niceness. */
+#define NICE_MAX 20  /* Highest niceness. */
+
+/* Run queue for the fair scheduler: ready threads ordered by
+   virtual runtime, the CPU time each has received divided by its
+   weight.  The thread that has received the least runs next, so
+   over time each runnable thread gets CPU time in proportion to
+   its weight and none starves. */
+static struct rb_tree fair_ready_tree;
+static uint64_t fair_min_vruntime; /* Lower bound on runnable vruntimes. */
+static unsigned fair_ready_weight; /* Total weight of ready threads. */
+
+/* Fair scheduler weight for each priority.  Each priority step
+   is worth 10% more CPU time than the one below it. */
+#define FAIR_WEIGHT_DEFAULT 1024 /* Weight at PRI_DEFAULT. */
+static unsigned fair_weights[PRI_MAX + 1];
+
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
@@ -51,13 +86,22 @@ static long long user_ticks;   /* # of timer ticks in user programs. */
 
 /* Scheduling. */
 #define TIME_SLICE 4          /* # of timer ticks to give each thread. */
+#define FAIR_LATENCY 20       /* # of ticks to share among fair threads. */
 static unsigned thread_ticks; /* # of timer ticks since last yield. */
+static unsigned thread_slice; /* # of timer ticks the running thread gets. */
 
 static void init_thread(struct thread*, const char* name, int priority);
 static bool is_thread(struct thread*) UNUSED;
 static void* alloc_frame(struct thread*, size_t size);
 static void schedule(void);
 static void thread_enqueue(struct thread* t);
+static void thread_dequeue(struct thread* t);
+static int highest_ready_priority(void);
+static bool vruntime_less(const struct rb_elem*, const struct rb_elem*, void* aux);
+static unsigned time_slice(struct thread*);
+static void set_effective_priority(struct thread*, int priority);
+static void mlfqs_tick(struct thread*);
+static int mlfqs_priority(const struct thread*);
 static tid_t allocate_tid(void);
 void thread_switch_tail(struct thread* prev);
 
@@ -104,12 +148,25 @@ scheduler_func* scheduler_jump_table[8] = {thread_schedule_fifo,     thread_sche
    It is not safe to call thread_current() until this function
    finishes. */
 void thread_init(void) {
+  int i;
+
   ASSERT(intr_get_level() == INTR_OFF);
 
-  lock_init(&tid_lock);
+  lock_init_named(&tid_lock, "tid_lock");
   list_init(&fifo_ready_list);
+  for (i = 0; i <= PRI_MAX; i++)
+    list_init(&prio_ready_lists[i]);
+  rb_init(&fair_ready_tree, vruntime_less, NULL);
+  list_init(&mlfqs_ran_list);
   list_init(&all_list);
 
+  fair_weights[PRI_DEFAULT] = FAIR_WEIGHT_DEFAULT;
+  for (i = PRI_DEFAULT + 1; i <= PRI_MAX; i++)
+    fair_weights[i] = fair_weights[i - 1] * 11 / 10;
+  for (i = PRI_DEFAULT - 1; i >= PRI_MIN; i--)
+    fair_weights[i] = fair_weights[i + 1] * 10 / 11;
+  thread_slice = TIME_SLICE;
+
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread();
   init_thread(initial_thread, "main", PRI_DEFAULT);
@@ -147,11 +204,51 @@ void thread_tick(void) {
   else
     kernel_ticks++;
 
+  /* Charge the tick to the running thread's virtual runtime. */
+  if (active_sched_policy == SCHED_FAIR && t != idle_thread)
+    t->vruntime += ((uint64_t)FAIR_WEIGHT_DEFAULT << 10) / fair_weights[t->priority];
+  else if (active_sched_policy == SCHED_MLFQS)
+    mlfqs_tick(t);
+
   /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  if (++thread_ticks >= thread_slice)
     intr_yield_on_return();
 }
 
+/* Charges the time-stamp counter cycles since T's usage mark to
+   its user time if USER is true, or to its kernel time
+   otherwise, and moves the mark to NOW. */
+static void charge_usage(struct thread* t, uint64_t now, bool user) {
+  uint64_t* cycles = user ? &t->usage.user_cycles : &t->usage.kernel_cycles;
+
+  *cycles += now - t->usage_mark;
+  t->usage_mark = now;
+}
+
+/* Charges the running thread's CPU time since the last charge to
+   user mode if USER is true, or to the kernel otherwise.  Called
+   on entry to the kernel from user mode with USER true, and on
+   return to user mode with USER false.  Switches between threads
+   charge the kernel implicitly. */
+void thread_charge_cpu(bool user) {
+  enum intr_level old_level = intr_disable();
+  charge_usage(thread_current(), rdtsc(), user);
+  intr_set_level(old_level);
+}
+
+/* Stores thread T's CPU usage in USAGE.  If T is the running
+   thread, the time since its last charge counts as kernel time,
+   since T is running in the kernel.
+
+   This function must be called with interrupts turned off. */
+void thread_get_usage(struct thread* t, struct rusage* usage) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (t == running_thread())
+    charge_usage(t, rdtsc(), false);
+  *usage = t->usage;
+}
+
 /* Prints thread statistics. */
 void thread_print_stats(void) {
   printf("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n", idle_ticks, kernel_ticks,
@@ -170,9 +267,8 @@ void thread_print_stats(void) {
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   Under the priority scheduler, the new thread preempts the
+   running thread right away if PRIORITY is higher. */
 tid_t thread_create(const char* name, int priority, thread_func* function, void* aux) {
   struct thread* t;
   struct kernel_thread_frame* kf;
@@ -214,6 +310,7 @@ tid_t thread_create(const char* name, int priority, thread_func* function, void*
 
   /* Add to run queue. */
   thread_unblock(t);
+  thread_preempt();
 
   return tid;
 }
@@ -228,6 +325,7 @@ void thread_block(void) {
   ASSERT(!intr_context());
   ASSERT(intr_get_level() == INTR_OFF);
 
+  sched_trace(SCHED_BLOCK, thread_current(), NULL);
   thread_current()->status = THREAD_BLOCKED;
   schedule();
 }
@@ -240,12 +338,68 @@ static void thread_enqueue(struct thread* t) {
   ASSERT(intr_get_level() == INTR_OFF);
   ASSERT(is_thread(t));
 
+  sched_trace(SCHED_ENQUEUE, t, NULL);
+  t->ready_since = rdtsc();
   if (active_sched_policy == SCHED_FIFO)
     list_push_back(&fifo_ready_list, &t->elem);
-  else
+  else if (active_sched_policy == SCHED_PRIO || active_sched_policy == SCHED_MLFQS) {
+    list_push_back(&prio_ready_lists[t->priority], &t->elem);
+    prio_ready_bitmap |= (uint64_t)1 << t->priority;
+    prio_ready_cnt++;
+  } else if (active_sched_policy == SCHED_FAIR) {
+    /* A thread that has been asleep gets no credit for the time
+       it did not use, or it could monopolize the CPU on waking. */
+    if (t->vruntime < fair_min_vruntime)
+      t->vruntime = fair_min_vruntime;
+    rb_insert(&fair_ready_tree, &t->rbelem);
+    fair_ready_weight += fair_weights[t->priority];
+  } else
     PANIC("Unimplemented scheduling policy value: %d", active_sched_policy);
 }
 
+/* Removes ready thread T from the ready structure, so that it
+   can be enqueued again after a change in its priority.
+
+   This function must be called with interrupts turned off. */
+static void thread_dequeue(struct thread* t) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(t->status == THREAD_READY);
+
+  if (active_sched_policy == SCHED_FAIR) {
+    rb_remove(&fair_ready_tree, &t->rbelem);
+    fair_ready_weight -= fair_weights[t->priority];
+  } else {
+    list_remove(&t->elem);
+    if (thread_priority_scheduling()) {
+      if (list_empty(&prio_ready_lists[t->priority]))
+        prio_ready_bitmap &= ~((uint64_t)1 << t->priority);
+      prio_ready_cnt--;
+    }
+  }
+}
+
+/* Returns true if the active scheduler always runs the
+   highest-priority ready thread, false otherwise. */
+bool thread_priority_scheduling(void) {
+  return active_sched_policy == SCHED_PRIO || active_sched_policy == SCHED_MLFQS;
+}
+
+/* Returns the priority of the highest-priority ready thread
+   under the priority or MLFQS scheduler, or -1 if no thread is
+   ready. */
+static int highest_ready_priority(void) {
+  uint32_t hi = prio_ready_bitmap >> 32;
+  uint32_t lo = prio_ready_bitmap;
+
+  /* __builtin_clz() compiles to a single BSR. */
+  if (hi != 0)
+    return 63 - __builtin_clz(hi);
+  else if (lo != 0)
+    return 31 - __builtin_clz(lo);
+  else
+    return -1;
+}
+
 /* Transitions a blocked thread T to the ready-to-run state.
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
@@ -261,11 +415,45 @@ void thread_unblock(struct thread* t) {
 
   old_level = intr_disable();
   ASSERT(t->status == THREAD_BLOCKED);
+  sched_trace(SCHED_UNBLOCK, t, running_thread());
   thread_enqueue(t);
   t->status = THREAD_READY;
+
+  /* An interrupt handler can only request a yield, which takes
+     effect when it returns, so there is no harm in asking here.
+     This gets a thread woken by the timer or a device onto the
+     CPU without waiting out the running thread's time slice. */
+  if (intr_context() && thread_priority_scheduling() && t->priority > thread_current()->priority)
+    intr_yield_on_return();
   intr_set_level(old_level);
 }
 
+/* Yields the CPU if the priority or MLFQS scheduler is active and
+   a ready thread has a higher priority than the running thread.  In an
+   interrupt handler, the yield happens as the handler returns.
+   Otherwise, the yield is skipped if interrupts are off, because
+   the caller is then in a critical section that it expects to be
+   atomic; the running thread will be preempted at its next time
+   slice at the latest. */
+void thread_preempt(void) {
+  enum intr_level old_level;
+  bool preempt;
+
+  if (!thread_priority_scheduling())
+    return;
+
+  old_level = intr_disable();
+  preempt = highest_ready_priority() > thread_current()->priority;
+  intr_set_level(old_level);
+
+  if (!preempt)
+    return;
+  if (intr_context())
+    intr_yield_on_return();
+  else if (old_level == INTR_ON)
+    thread_yield();
+}
+
 /* Returns the name of the running thread. */
 const char* thread_name(void) { return thread_current()->name; }
 
@@ -299,6 +487,8 @@ void thread_exit(void) {
      when it calls thread_switch_tail(). */
   intr_disable();
   list_remove(&thread_current()->allelem);
+  if (thread_current()->mlfqs_ran)
+    list_remove(&thread_current()->ranelem);
   thread_current()->status = THREAD_DYING;
   schedule();
   NOT_REACHED();
@@ -333,32 +523,206 @@ void thread_foreach(thread_action_func* func, void* aux) {
   }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
-void thread_set_priority(int new_priority) { thread_current()->priority = new_priority; }
+/* Sets the current thread's base priority to NEW_PRIORITY.  The
+   thread keeps running at any higher priority donated to it
+   until it releases the locks involved.  Yields if some ready
+   thread now has a higher priority.  Ignored under the MLFQS
+   scheduler, which computes priorities itself. */
+void thread_set_priority(int new_priority) {
+  struct thread* cur = thread_current();
+  enum intr_level old_level;
+
+  ASSERT(PRI_MIN <= new_priority && new_priority <= PRI_MAX);
 
-/* Returns the current thread's priority. */
+  if (active_sched_policy == SCHED_MLFQS)
+    return;
+
+  old_level = intr_disable();
+  cur->base_priority = new_priority;
+  thread_update_priority(cur);
+  intr_set_level(old_level);
+
+  thread_preempt();
+}
+
+/* Returns the current thread's priority, including donations. */
 int thread_get_priority(void) { return thread_current()->priority; }
 
-/* Sets the current thread's nice value to NICE. */
-void thread_set_nice(int nice UNUSED) { /* Not yet implemented. */
+/* Changes ready, running, or blocked thread T's priority to
+   PRIORITY, moving T to the matching ready queue if it is ready. */
+static void set_effective_priority(struct thread* t, int priority) {
+  if (t->priority == priority)
+    return;
+  if (t->status == THREAD_READY) {
+    thread_dequeue(t);
+    t->priority = priority;
+    thread_enqueue(t);
+  } else
+    t->priority = priority;
 }
 
-/* Returns the current thread's nice value. */
-int thread_get_nice(void) {
-  /* Not yet implemented. */
-  return 0;
+/* Maximum length of the chain of lock holders that a donation
+   is passed along, which bounds the time spent in
+   thread_donate_priority() even if the chain has a cycle. */
+#define DONATE_DEPTH 8
+
+/* Donates thread T's priority to the holder of the lock T is
+   waiting for, and onward along the chain of holders that are
+   themselves waiting for a lock, so that a high-priority thread
+   waits no longer than the critical sections in its way.
+
+   This function must be called with interrupts turned off. */
+void thread_donate_priority(struct thread* t) {
+  int depth;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (active_sched_policy != SCHED_PRIO)
+    return;
+
+  for (depth = 0; depth < DONATE_DEPTH && t->waiting_lock != NULL; depth++) {
+    struct thread* holder = t->waiting_lock->holder;
+    if (holder == NULL || holder->priority >= t->priority)
+      break;
+    set_effective_priority(holder, t->priority);
+    t = holder;
+  }
+}
+
+/* Recomputes thread T's priority as the higher of its base
+   priority and the priorities of the threads waiting for locks
+   that T holds.  Called when T releases a lock or changes its
+   base priority.
+
+   This function must be called with interrupts turned off. */
+void thread_update_priority(struct thread* t) {
+  int priority = t->base_priority;
+  struct list_elem* e;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (active_sched_policy == SCHED_MLFQS)
+    return;
+  if (active_sched_policy == SCHED_PRIO)
+    for (e = list_begin(&t->held_locks); e != list_end(&t->held_locks); e = list_next(e)) {
+      struct list* waiters = &list_entry(e, struct lock, elem)->semaphore.waiters;
+      if (!list_empty(waiters)) {
+        struct thread* w =
+            list_entry(list_max(waiters, thread_priority_less, NULL), struct thread, elem);
+        if (w->priority > priority)
+          priority = w->priority;
+      }
+    }
+  set_effective_priority(t, priority);
+}
+
+/* Orders threads, given their `elem' members, by ascending
+   priority.  With list_max(), picks the highest-priority thread,
+   taking the earliest of threads with equal priority. */
+bool thread_priority_less(const struct list_elem* a_, const struct list_elem* b_,
+                          void* aux UNUSED) {
+  const struct thread* a = list_entry(a_, struct thread, elem);
+  const struct thread* b = list_entry(b_, struct thread, elem);
+
+  return a->priority < b->priority;
+}
+
+/* Sets the current thread's nice value to NICE.
+   Under the MLFQS scheduler, also recomputes the thread's
+   priority and yields if it is no longer the highest. */
+void thread_set_nice(int nice) {
+  struct thread* cur = thread_current();
+  enum intr_level old_level;
+
+  ASSERT(NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable();
+  cur->nice = nice;
+  if (active_sched_policy == SCHED_MLFQS)
+    cur->priority = mlfqs_priority(cur);
+  intr_set_level(old_level);
+
+  thread_preempt();
 }
 
+/* Returns the current thread's nice value. */
+int thread_get_nice(void) { return thread_current()->nice; }
+
 /* Returns 100 times the system load average. */
 int thread_get_load_avg(void) {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable();
+  int load_avg_100 = fix_round(fix_scale(load_avg, 100));
+  intr_set_level(old_level);
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int thread_get_recent_cpu(void) {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable();
+  int recent_cpu_100 = fix_round(fix_scale(thread_current()->recent_cpu, 100));
+  intr_set_level(old_level);
+  return recent_cpu_100;
+}
+
+/* Returns the MLFQS priority for T's nice value and recent_cpu. */
+static int mlfqs_priority(const struct thread* t) {
+  int priority = PRI_MAX - fix_trunc(fix_unscale(t->recent_cpu, 4)) - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    return PRI_MIN;
+  else if (priority > PRI_MAX)
+    return PRI_MAX;
+  else
+    return priority;
+}
+
+/* Decays thread T's recent_cpu by COEFF, as the MLFQS scheduler
+   does once per second, and recomputes its priority. */
+static void mlfqs_decay(struct thread* t, void* coeff_) {
+  fixed_point_t* coeff = coeff_;
+
+  if (t == idle_thread)
+    return;
+  t->recent_cpu = fix_add(fix_mul(*coeff, t->recent_cpu), fix_int(t->nice));
+  set_effective_priority(t, mlfqs_priority(t));
+}
+
+/* Does the MLFQS scheduler's bookkeeping for a timer tick during
+   which T was running.  Runs in an external interrupt context. */
+static void mlfqs_tick(struct thread* t) {
+  int64_t now = timer_ticks();
+
+  if (t != idle_thread) {
+    t->recent_cpu = fix_add(t->recent_cpu, fix_int(1));
+    if (!t->mlfqs_ran) {
+      t->mlfqs_ran = true;
+      list_push_back(&mlfqs_ran_list, &t->ranelem);
+    }
+  }
+
+  /* Once per second, update the load average and decay every
+     thread's recent_cpu.  The latter changes every priority. */
+  if (now % TIMER_FREQ == 0) {
+    int ready = prio_ready_cnt + (t != idle_thread);
+    fixed_point_t coeff;
+
+    load_avg =
+        fix_add(fix_mul(fix_frac(59, 60), load_avg), fix_scale(fix_frac(1, 60), ready));
+    coeff = fix_div(fix_scale(load_avg, 2), fix_add(fix_scale(load_avg, 2), fix_int(1)));
+    thread_foreach(mlfqs_decay, &coeff);
+  }
+
+  /* Every fourth tick, update the priorities of the threads that
+     were charged a tick since the last update.  No other
+     thread's recent_cpu has changed. */
+  if (now % TIME_SLICE == 0) {
+    while (!list_empty(&mlfqs_ran_list)) {
+      struct thread* r = list_entry(list_pop_front(&mlfqs_ran_list), struct thread, ranelem);
+      r->mlfqs_ran = false;
+      set_effective_priority(r, mlfqs_priority(r));
+    }
+    thread_preempt();
+  }
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -380,6 +744,15 @@ static void idle(void* idle_started_ UNUSED) {
     intr_disable();
     thread_block();
 
+    /* Nothing else is ready to run.  Zero a free page for later
+       PAL_ZERO requests, then take any pending interrupts and go
+       back through the scheduler, since one of them may have
+       made another thread ready. */
+    if (palloc_zero_idle()) {
+      intr_enable();
+      continue;
+    }
+
     /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -391,7 +764,11 @@ static void idle(void* idle_started_ UNUSED) {
          time.
 
          See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
-         7.11.1 "HLT Instruction". */
+         7.11.1 "HLT Instruction".
+
+         In tickless mode, timer_idle() first stops the periodic
+         timer interrupt if no timer is due soon. */
+    timer_idle();
     asm volatile("sti; hlt" : : : "memory");
   }
 }
@@ -433,7 +810,18 @@ static void init_thread(struct thread* t, const char* name, int priority) {
   t->status = THREAD_BLOCKED;
   strlcpy(t->name, name, sizeof t->name);
   t->stack = (uint8_t*)t + PGSIZE;
-  t->priority = priority;
+  t->priority = t->base_priority = priority;
+  list_init(&t->held_locks);
+
+  /* Under MLFQS, a new thread inherits its creator's niceness and
+     recent CPU time, and its priority follows from them. */
+  if (active_sched_policy == SCHED_MLFQS) {
+    if (t != running_thread()) {
+      t->nice = running_thread()->nice;
+      t->recent_cpu = running_thread()->recent_cpu;
+    }
+    t->priority = mlfqs_priority(t);
+  }
   t->pcb = NULL;
   t->magic = THREAD_MAGIC;
 
@@ -463,19 +851,66 @@ static struct thread* thread_schedule_fifo(void) {
 
 /* Strict priority scheduler */
 static struct thread* thread_schedule_prio(void) {
-  PANIC("Unimplemented scheduler policy: \"-sched=prio\"");
+  int priority = highest_ready_priority();
+  struct list* list;
+  struct thread* t;
+
+  if (priority < 0)
+    return idle_thread;
+
+  list = &prio_ready_lists[priority];
+  t = list_entry(list_pop_front(list), struct thread, elem);
+  if (list_empty(list))
+    prio_ready_bitmap &= ~((uint64_t)1 << priority);
+  prio_ready_cnt--;
+  return t;
 }
 
 /* Fair priority scheduler */
 static struct thread* thread_schedule_fair(void) {
-  PANIC("Unimplemented scheduler policy: \"-sched=fair\"");
+  struct rb_elem* e = rb_min(&fair_ready_tree);
+  struct thread* t;
+
+  if (e == NULL)
+    return idle_thread;
+
+  t = rb_entry(e, struct thread, rbelem);
+  rb_remove(&fair_ready_tree, e);
+  fair_ready_weight -= fair_weights[t->priority];
+  if (t->vruntime > fair_min_vruntime)
+    fair_min_vruntime = t->vruntime;
+  return t;
+}
+
+/* Orders threads, given their `rbelem' members, by ascending
+   virtual runtime. */
+static bool vruntime_less(const struct rb_elem* a_, const struct rb_elem* b_, void* aux UNUSED) {
+  const struct thread* a = rb_entry(a_, struct thread, rbelem);
+  const struct thread* b = rb_entry(b_, struct thread, rbelem);
+
+  return a->vruntime < b->vruntime;
 }
 
-/* Multi-level feedback queue scheduler */
-static struct thread* thread_schedule_mlfqs(void) {
-  PANIC("Unimplemented scheduler policy: \"-sched=mlfqs\"");
+/* Returns the number of ticks that T may run before it is
+   preempted.  The fair scheduler divides FAIR_LATENCY ticks among
+   the runnable threads in proportion to their weights, so that
+   each of them runs about once per FAIR_LATENCY ticks, but gives
+   every thread at least one tick. */
+static unsigned time_slice(struct thread* t) {
+  unsigned weight, slice;
+
+  if (active_sched_policy != SCHED_FAIR || t == idle_thread)
+    return TIME_SLICE;
+
+  weight = fair_weights[t->priority];
+  slice = FAIR_LATENCY * weight / (fair_ready_weight + weight);
+  return slice > 0 ? slice : 1;
 }
 
+/* Multi-level feedback queue scheduler.  The queues are the
+   strict-priority scheduler's; only the priorities differ. */
+static struct thread* thread_schedule_mlfqs(void) { return thread_schedule_prio(); }
+
 /* Not an actual scheduling policy — placeholder for empty
  * slots in the scheduler jump table. */
 static struct thread* thread_schedule_reserved(void) {
@@ -509,14 +944,33 @@ static struct thread* next_thread_to_run(void) {
    is complete. */
 void thread_switch_tail(struct thread* prev) {
   struct thread* cur = running_thread();
+  uint64_t now = rdtsc();
 
   ASSERT(intr_get_level() == INTR_OFF);
 
   /* Mark us as running. */
   cur->status = THREAD_RUNNING;
+  sched_trace(SCHED_SWITCH, cur, prev);
+  rcu_quiescent();
+
+  /* Account for the switch.  PREV was switched out in the kernel
+     and gave up the CPU voluntarily unless it is still ready. */
+  if (prev != NULL) {
+    charge_usage(prev, now, false);
+    if (prev->status == THREAD_READY)
+      prev->usage.invol_switches++;
+    else
+      prev->usage.vol_switches++;
+    cur->usage_mark = now;
+  }
+  if (cur->ready_since != 0) {
+    cur->usage.wait_cycles += now - cur->ready_since;
+    cur->ready_since = 0;
+  }
 
   /* Start new time slice. */
   thread_ticks = 0;
+  thread_slice = time_slice(cur);
 
 #ifdef USERPROG
   /* Activate the new address space. */
@@ -548,8 +1002,10 @@ static void schedule(void) {
 
   ASSERT(intr_get_level() == INTR_OFF);
   ASSERT(cur->status != THREAD_RUNNING);
+  ASSERT(cur->rcu_depth == 0);
   ASSERT(is_thread(next));
 
+  sched_trace(SCHED_DEQUEUE, next, cur);
   if (cur != next)
     prev = switch_threads(cur, next);
   thread_switch_tail(prev);
@@ -3,6 +3,8 @@
 
 #include <debug.h>
 #include <list.h>
+#include <rbtree.h>
+#include <rusage.h>
 #include <stdint.h>
 #include "threads/synch.h"
 #include "threads/fixed-point.h"
@@ -87,15 +89,30 @@ struct thread {
   enum thread_status status; /* Thread state. */
   char name[16];             /* Name (for debugging purposes). */
   uint8_t* stack;            /* Saved stack pointer. */
-  int priority;              /* Priority. */
+  int priority;              /* Priority, including donations. */
+  int base_priority;         /* Priority before donations. */
   struct list_elem allelem;  /* List element for all threads list. */
+  struct rb_elem rbelem;     /* Element in fair scheduler's run queue. */
+  uint64_t vruntime;         /* Run time weighted by priority. */
+  int nice;                  /* Niceness, for -sched=mlfqs. */
+  fixed_point_t recent_cpu;  /* Recent CPU time, for -sched=mlfqs. */
+  bool mlfqs_ran;            /* On mlfqs_ran_list? */
+  struct list_elem ranelem;  /* Element in mlfqs_ran_list. */
+  struct rusage usage;       /* CPU usage. */
+  uint64_t usage_mark;       /* TSC when CPU time was last charged. */
+  uint64_t ready_since;      /* TSC when last made ready, or 0. */
 
   /* Shared between thread.c and synch.c. */
-  struct list_elem elem; /* List element. */
+  struct list_elem elem;     /* List element. */
+  struct list held_locks;    /* Locks held, for recomputing donations. */
+  struct lock* waiting_lock; /* Lock being waited for, or null. */
+  int rcu_depth;             /* Nesting of RCU read-side sections. */
+  bool rcu_yield;            /* Preempted in an RCU read-side section? */
 
 #ifdef USERPROG
   /* Owned by process.c. */
   struct process* pcb; /* Process control block if this thread is a userprog */
+  void* user_esp;      /* User stack pointer on the last system call. */
 #endif
 
   /* Owned by thread.c. */
@@ -123,12 +140,15 @@ void thread_start(void);
 
 void thread_tick(void);
 void thread_print_stats(void);
+void thread_charge_cpu(bool user);
+void thread_get_usage(struct thread*, struct rusage*);
 
 typedef void thread_func(void* aux);
 tid_t thread_create(const char* name, int priority, thread_func*, void*);
 
 void thread_block(void);
 void thread_unblock(struct thread*);
+void thread_preempt(void);
 
 struct thread* thread_current(void);
 tid_t thread_tid(void);
@@ -143,6 +163,10 @@ void thread_foreach(thread_action_func*, void*);
 
 int thread_get_priority(void);
 void thread_set_priority(int);
+void thread_donate_priority(struct thread*);
+void thread_update_priority(struct thread*);
+bool thread_priority_less(const struct list_elem*, const struct list_elem*, void* aux);
+bool thread_priority_scheduling(void);
 
 int thread_get_nice(void);
 void thread_set_nice(int);
@@ -0,0 +1,15 @@
+#ifndef THREADS_TSC_H
+#define THREADS_TSC_H
+
+#include <stdint.h>
+
+/* Returns the CPU's time-stamp counter, which counts clock
+   cycles since reset.  See [IA32-v2b] "RDTSC--Read Time-Stamp
+   Counter". */
+static inline uint64_t rdtsc(void) {
+  uint32_t lo, hi;
+  asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+#endif /* threads/tsc.h */
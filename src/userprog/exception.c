@@ -3,8 +3,13 @@
 #include <stdio.h>
 #include "userprog/gdt.h"
 #include "userprog/process.h"
+#include "userprog/uaccess.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -75,6 +80,7 @@ static void kill(struct intr_frame* f) {
     case SEL_UCSEG:
       /* User's code segment, so it's a user exception, as we
          expected.  Kill the user process.  */
+      process_flush_stdout();
       printf("%s: dying due to interrupt %#04x (%s).\n", thread_name(), f->vec_no,
              intr_name(f->vec_no));
       intr_dump_frame(f);
@@ -135,9 +141,25 @@ static void page_fault(struct intr_frame* f) {
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
-  /* To implement virtual memory, delete the rest of the function
-     body, and replace it with code that brings in the page to
-     which fault_addr refers. */
+#ifdef VM
+  /* Bring in the page if it belongs to the process but has not
+     been loaded yet, or copy it if it is a copy-on-write page
+     being written.  This applies to kernel accesses to user
+     memory as much as to the user's own. */
+  if (page_handle_fault(fault_addr, not_present, write,
+                        user ? f->esp : thread_current()->user_esp))
+    return;
+#endif
+
+  /* The kernel touched a bad user address through one of the
+     uaccess primitives.  That is the user's fault, not a kernel
+     bug: make the primitive report failure to its caller. */
+  if (!user && is_user_vaddr(fault_addr) && uaccess_fixup(f))
+    return;
+
+  /* Every fault that reaches this point is a real error: either
+     a user program accessed memory it may not touch, or the
+     kernel itself faulted, which is a kernel bug. */
   printf("Page fault at %p: %s error %s page in %s context.\n", fault_addr,
          not_present ? "not present" : "rights violation", write ? "writing" : "reading",
          user ? "user" : "kernel");
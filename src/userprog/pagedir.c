@@ -7,6 +7,7 @@
 #include "threads/palloc.h"
 
 static void invalidate_pagedir(uint32_t*);
+static void invalidate_page(uint32_t*, const void* upage);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -29,7 +30,9 @@ void pagedir_destroy(uint32_t* pd) {
 
   ASSERT(pd != init_page_dir);
   for (pde = pd; pde < pd + pd_no(PHYS_BASE); pde++)
-    if (*pde & PTE_P) {
+    if ((*pde & PTE_P) && pde_is_large(*pde))
+      palloc_free_multiple(pde_get_large(*pde), LPGPAGES);
+    else if (*pde & PTE_P) {
       uint32_t* pt = pde_get_pt(*pde);
       uint32_t* pte;
 
@@ -56,8 +59,13 @@ static uint32_t* lookup_page(uint32_t* pd, const void* vaddr, bool create) {
   ASSERT(!create || is_user_vaddr(vaddr));
 
   /* Check for a page table for VADDR.
-     If one is missing, create one if requested. */
+     If one is missing, create one if requested.  A large page
+     has no page table, so no PTE either. */
   pde = pd + pd_no(vaddr);
+  if ((*pde & PTE_P) && pde_is_large(*pde)) {
+    ASSERT(!create);
+    return NULL;
+  }
   if (*pde == 0) {
     if (create) {
       pt = palloc_get_page(PAL_ZERO);
@@ -103,15 +111,43 @@ bool pagedir_set_page(uint32_t* pd, void* upage, void* kpage, bool writable) {
     return false;
 }
 
+/* Adds a mapping in page directory PD from the 4 MB of user
+   virtual memory starting at UPAGE to the large page at kernel
+   virtual address KPAGE, both of which must be 4 MB aligned.
+   KPAGE should be a run of LPGPAGES pages obtained from the user
+   pool with palloc_get_aligned(); pagedir_destroy() frees it.
+   If WRITABLE is true, the new page is read/write; otherwise it
+   is read-only.
+   Returns true if successful, false if some of the 4 MB region
+   is already mapped. */
+bool pagedir_set_large_page(uint32_t* pd, void* upage, void* kpage, bool writable) {
+  uint32_t* pde;
+
+  ASSERT(((uintptr_t)upage & LPGMASK) == 0);
+  ASSERT(is_user_vaddr(upage));
+  ASSERT(pd != init_page_dir);
+
+  pde = pd + pd_no(upage);
+  if (*pde != 0)
+    return false;
+  *pde = pde_create_large(kpage, writable, true);
+  return true;
+}
+
 /* Looks up the physical address that corresponds to user virtual
    address UADDR in PD.  Returns the kernel virtual address
    corresponding to that physical address, or a null pointer if
    UADDR is unmapped. */
 void* pagedir_get_page(uint32_t* pd, const void* uaddr) {
+  uint32_t pde;
   uint32_t* pte;
 
   ASSERT(is_user_vaddr(uaddr));
 
+  pde = pd[pd_no(uaddr)];
+  if ((pde & PTE_P) && pde_is_large(pde))
+    return (uint8_t*)pde_get_large(pde) + ((uintptr_t)uaddr & LPGMASK);
+
   pte = lookup_page(pd, uaddr, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
     return pte_get_page(*pte) + pg_ofs(uaddr);
@@ -132,10 +168,52 @@ void pagedir_clear_page(uint32_t* pd, void* upage) {
   pte = lookup_page(pd, upage, false);
   if (pte != NULL && (*pte & PTE_P) != 0) {
     *pte &= ~PTE_P;
-    invalidate_pagedir(pd);
+    invalidate_page(pd, upage);
   }
 }
 
+/* Starts BATCH, a batch of user pages to be unmapped from page
+   directory PD with pagedir_batch_clear_page(). */
+void pagedir_batch_init(struct pagedir_batch* batch, uint32_t* pd) {
+  batch->pd = pd;
+  batch->page_cnt = 0;
+}
+
+/* Like pagedir_clear_page(), but the TLB may keep translating
+   UPAGE until pagedir_batch_finish() is called for BATCH.  Until
+   then, the caller must neither touch UPAGE nor return to user
+   mode.  Other threads cannot use the stale translation, since
+   switching to one reloads the TLB. */
+void pagedir_batch_clear_page(struct pagedir_batch* batch, void* upage) {
+  uint32_t* pte;
+
+  ASSERT(pg_ofs(upage) == 0);
+  ASSERT(is_user_vaddr(upage));
+
+  pte = lookup_page(batch->pd, upage, false);
+  if (pte != NULL && (*pte & PTE_P) != 0) {
+    *pte &= ~PTE_P;
+    if (batch->page_cnt < PAGEDIR_BATCH_PAGES)
+      batch->pages[batch->page_cnt] = upage;
+    batch->page_cnt++;
+  }
+}
+
+/* Brings the TLB up to date with the pages unmapped in BATCH,
+   with one INVLPG per page if there were only a few of them and
+   by flushing the whole TLB otherwise.  BATCH may then be used
+   for more pages. */
+void pagedir_batch_finish(struct pagedir_batch* batch) {
+  size_t i;
+
+  if (batch->page_cnt > PAGEDIR_BATCH_PAGES)
+    invalidate_pagedir(batch->pd);
+  else
+    for (i = 0; i < batch->page_cnt; i++)
+      invalidate_page(batch->pd, batch->pages[i]);
+  batch->page_cnt = 0;
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
    that is, if the page has been modified since the PTE was
    installed.
@@ -154,7 +232,7 @@ void pagedir_set_dirty(uint32_t* pd, const void* vpage, bool dirty) {
       *pte |= PTE_D;
     else {
       *pte &= ~(uint32_t)PTE_D;
-      invalidate_pagedir(pd);
+      invalidate_page(pd, vpage);
     }
   }
 }
@@ -177,7 +255,7 @@ void pagedir_set_accessed(uint32_t* pd, const void* vpage, bool accessed) {
       *pte |= PTE_A;
     else {
       *pte &= ~(uint32_t)PTE_A;
-      invalidate_pagedir(pd);
+      invalidate_page(pd, vpage);
     }
   }
 }
@@ -222,3 +300,13 @@ static void invalidate_pagedir(uint32_t* pd) {
     pagedir_activate(pd);
   }
 }
+
+/* Invalidates the TLB entry for user page UPAGE if PD is the
+   active page directory.  This is much cheaper than
+   invalidate_pagedir() when only one page has changed, because
+   the rest of the TLB survives.  See [IA32-v2a] "INVLPG--
+   Invalidate TLB Entry". */
+static void invalidate_page(uint32_t* pd, const void* upage) {
+  if (active_pd() == pd)
+    asm volatile("invlpg (%0)" : : "r"(upage) : "memory");
+}
@@ -2,17 +2,34 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* Largest batch whose pages are invalidated in the TLB one at a
+   time.  For bigger batches, flushing the whole TLB is cheaper. */
+#define PAGEDIR_BATCH_PAGES 32
+
+/* A batch of user pages unmapped from one page directory, whose
+   TLB invalidation is put off until the batch is finished. */
+struct pagedir_batch {
+  uint32_t* pd;                      /* Page directory being changed. */
+  size_t page_cnt;                   /* Number of pages unmapped so far. */
+  void* pages[PAGEDIR_BATCH_PAGES];  /* The first pages unmapped. */
+};
+
 uint32_t* pagedir_create(void);
 void pagedir_destroy(uint32_t* pd);
 bool pagedir_set_page(uint32_t* pd, void* upage, void* kpage, bool rw);
+bool pagedir_set_large_page(uint32_t* pd, void* upage, void* kpage, bool rw);
 void* pagedir_get_page(uint32_t* pd, const void* upage);
 void pagedir_clear_page(uint32_t* pd, void* upage);
 bool pagedir_is_dirty(uint32_t* pd, const void* upage);
 void pagedir_set_dirty(uint32_t* pd, const void* upage, bool dirty);
 bool pagedir_is_accessed(uint32_t* pd, const void* upage);
 void pagedir_set_accessed(uint32_t* pd, const void* upage, bool accessed);
+void pagedir_batch_init(struct pagedir_batch*, uint32_t* pd);
+void pagedir_batch_clear_page(struct pagedir_batch*, void* upage);
+void pagedir_batch_finish(struct pagedir_batch*);
 void pagedir_activate(uint32_t* pd);
 uint32_t* active_pd(void);
 
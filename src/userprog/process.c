@@ -8,6 +8,7 @@
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
+#include "userprog/uaccess.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
@@ -16,13 +17,22 @@
 #include "threads/interrupt.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 static thread_func start_process NO_RETURN;
 static thread_func start_pthread NO_RETURN;
 static bool load(int argc, const char* const* argv, void (**eip)(void), void** esp);
+static void close_all_files(void);
+static void add_usage(struct rusage* sum, const struct rusage* u);
+static void free_file_info(struct rcu_head*);
 bool setup_thread(void (**eip)(void), void** esp);
 
 /* Arguments process_execute passes into the thread which start_process retrieves. */
@@ -35,6 +45,19 @@ struct thread_args {
   struct dir* working_dir;
 };
 
+/* Caches for the small structures every process_execute() and
+   open() allocates. */
+static struct kmem_cache exit_info_cache;
+static struct kmem_cache file_info_cache;
+static struct kmem_cache thread_args_cache;
+
+/* Constructor for exit_info_cache.  Each exit_info's access_lock
+   is free again by the time it is given back. */
+static void exit_info_ctor(void* ei_) {
+  struct exit_info* ei = ei_;
+  lock_init(&ei->access_lock);
+}
+
 /* Initializes user programs in the system by ensuring the main
    thread has a minimal PCB so that it can execute and wait for
    the first user process. Any additions to the PCB should be also
@@ -43,6 +66,10 @@ void userprog_init(void) {
   struct thread* t = thread_current();
   bool success;
 
+  kmem_cache_init(&exit_info_cache, "exit_info", sizeof(struct exit_info), exit_info_ctor);
+  kmem_cache_init(&file_info_cache, "file_info", sizeof(struct file_info), NULL);
+  kmem_cache_init(&thread_args_cache, "thread_args", sizeof(struct thread_args), NULL);
+
   /* Allocate process control block
      It is imoprtant that this is a call to calloc and not malloc,
      so that t->pcb->pagedir is guaranteed to be NULL (the kernel's
@@ -54,6 +81,11 @@ void userprog_init(void) {
   /* Initialize process members. No exit info or parent PID for Kernel. */
   list_init(&t->pcb->children_exit_infos);
   lock_init(&t->pcb->children_list_lock);
+  lock_init(&t->pcb->stdout_lock);
+#ifdef VM
+  page_table_init();
+  list_init(&t->pcb->mappings);
+#endif
   t->pcb->working_dir = dir_open_root();
   /* set kernel pcb to have current thread as main thread.*/
   t->pcb->main_thread = t;
@@ -90,7 +122,7 @@ pid_t process_execute(const char* cmd_line) {
   strlcpy(fn_copy, cmd_line, PGSIZE);
 
   /* Create the thread args. */
-  struct thread_args* args = calloc(1, sizeof(struct thread_args));
+  struct thread_args* args = kmem_cache_alloc(&thread_args_cache);
   args->cmd_line = fn_copy;
   args->parent_pid = t->pcb->main_thread->tid;
   args->load_success = load_success;
@@ -114,9 +146,10 @@ pid_t process_execute(const char* cmd_line) {
     lock_release(&t->pcb->children_list_lock);
   } else {
     dir_close(args->working_dir);
-    free(child_exit_info);
+    kmem_cache_free(&exit_info_cache, child_exit_info);
     tid = TID_ERROR;
   }
+  kmem_cache_free(&thread_args_cache, args);
 
 
   free(load_flag);
@@ -127,6 +160,11 @@ pid_t process_execute(const char* cmd_line) {
 /* start_process() helpers declaration  */
 static bool parse_args(char* cmd_line, int* argc, char** argv);
 
+#ifndef VM
+/* Map large zero-filled regions of user programs with 4 MB pages? */
+bool user_large_pages;
+#endif
+
 /* A thread function that loads a user process and starts it
    running. */
 static void start_process(void* args) {
@@ -169,11 +207,19 @@ static void start_process(void* args) {
     t->pcb->parent_pid = t_args->parent_pid;
     list_init(&t->pcb->children_exit_infos);
     lock_init(&t->pcb->children_list_lock);
+    memset(&t->pcb->child_usage, 0, sizeof t->pcb->child_usage);
 
     t->pcb->working_dir = t_args->working_dir;
 
     list_init(&t->pcb->file_descriptions);
-    lock_init(&t->pcb->fd_lock);
+    lock_init_named(&t->pcb->fd_lock, "fd_lock");
+    t->pcb->stdout_len = 0;
+    lock_init(&t->pcb->stdout_lock);
+#ifdef VM
+    page_table_init();
+    list_init(&t->pcb->mappings);
+    t->pcb->next_mapid = 0;
+#endif
     // Initialize at 2 to prevent conflicts with STDIN (0) and STDOUT (1)
     t->pcb->file_count = 2;
   }
@@ -203,6 +249,10 @@ static void start_process(void* args) {
     // If this happens, then an unfortuantely timed timer interrupt
     // can try to activate the pagedir, but it is now freed memory
     struct process* pcb_to_free = t->pcb;
+#ifdef VM
+    if (pcb_to_free != NULL)
+      page_table_destroy();
+#endif
     t->pcb = NULL;
     free(pcb_to_free);
   }
@@ -219,6 +269,7 @@ static void start_process(void* args) {
      arguments on the stack in the form of a `struct intr_frame',
      we just point the stack pointer (%esp) to our stack frame
      and jump to it. */
+  thread_charge_cpu(false);
   asm volatile("movl %0, %%esp; jmp intr_exit" : : "g"(&if_) : "memory");
   NOT_REACHED();
 }
@@ -255,16 +306,217 @@ static bool parse_args(char* cmd_line, int* argc, char** argv) {
 /* Process_execute helper for making child exit info. */
 static struct exit_info* make_child_exit_info(void) {
    /* Create an exit_info struct for the child. */
-  struct exit_info* child_exit_info = malloc(sizeof(struct exit_info));
+  struct exit_info* child_exit_info = kmem_cache_alloc(&exit_info_cache);
   child_exit_info->ref_count = 2;
   child_exit_info->exit_code = -1;
-  lock_init(&child_exit_info->access_lock);
+  memset(&child_exit_info->usage, 0, sizeof child_exit_info->usage);
   sema_init(&child_exit_info->death_trigger, 0);
 
   return child_exit_info;
 }
 
 
+#ifdef VM
+/* Arguments process_fork passes into the thread which start_fork retrieves. */
+struct fork_args {
+  struct process* parent;            /* Process being forked. */
+  struct intr_frame if_;             /* Parent's user context at the fork() call. */
+  struct exit_info* child_exit_info; /* Exit info shared with the parent. */
+  struct semaphore done;             /* Upped when the child is set up, or has failed. */
+  bool success;                      /* Whether the child was set up. */
+};
+
+static thread_func start_fork NO_RETURN;
+static bool fork_files(struct process* parent);
+static bool fork_memory(struct process* parent);
+static void fork_abort(void) NO_RETURN;
+
+/* Creates a child process that is a copy of the current one,
+   resuming from the user context in IF_ with fork() returning 0.
+   The child's address space shares the parent's frames rather
+   than copying them: private writable pages are copied only when
+   either process first writes them.  The child gets its own
+   handles on the parent's open files and directories, under the
+   same descriptors.  Returns the child's process id, or
+   TID_ERROR if it cannot be created. */
+pid_t process_fork(const struct intr_frame* if_) {
+  struct process* pcb = thread_current()->pcb;
+  struct fork_args* args;
+  tid_t tid;
+
+  /* Output the parent buffered before fork() must not appear
+     twice. */
+  process_flush_stdout();
+
+  args = malloc(sizeof *args);
+  if (args == NULL)
+    return TID_ERROR;
+  args->parent = pcb;
+  args->if_ = *if_;
+  args->child_exit_info = make_child_exit_info();
+  sema_init(&args->done, 0);
+  args->success = false;
+
+  tid = thread_create(pcb->process_name, PRI_DEFAULT, start_fork, args);
+  if (tid != TID_ERROR)
+    sema_down(&args->done);
+
+  if (args->success) {
+    lock_acquire(&pcb->children_list_lock);
+    /* Add the child exit info to the current process's list of child exit infos. */
+    list_push_back(&pcb->children_exit_infos, &args->child_exit_info->elem);
+    lock_release(&pcb->children_list_lock);
+  } else {
+    kmem_cache_free(&exit_info_cache, args->child_exit_info);
+    tid = TID_ERROR;
+  }
+
+  free(args);
+  return tid;
+}
+
+/* A thread function that sets up a copy of the process in
+   ARGS->parent and starts it running.  The parent waits in
+   process_fork() until this is done, so its state is stable
+   while it is being copied. */
+static void start_fork(void* args_) {
+  struct fork_args* args = args_;
+  struct process* parent = args->parent;
+  struct thread* t = thread_current();
+  struct intr_frame if_ = args->if_;
+  struct process* pcb;
+  bool success;
+
+  pcb = calloc(1, sizeof *pcb);
+  if (pcb == NULL) {
+    sema_up(&args->done);
+    thread_exit();
+  }
+
+  /* Initialize process control block.  calloc() left pagedir
+     null, so a timer interrupt can't activate a bogus one. */
+  t->pcb = pcb;
+  pcb->main_thread = t;
+  strlcpy(pcb->process_name, parent->process_name, sizeof pcb->process_name);
+  pcb->exit_info = args->child_exit_info;
+  pcb->parent_pid = parent->main_thread->tid;
+  list_init(&pcb->children_exit_infos);
+  lock_init(&pcb->children_list_lock);
+  list_init(&pcb->file_descriptions);
+  lock_init_named(&pcb->fd_lock, "fd_lock");
+  lock_init(&pcb->stdout_lock);
+  page_table_init();
+  list_init(&pcb->mappings);
+
+  pcb->pagedir = pagedir_create();
+  success = pcb->pagedir != NULL;
+  if (success) {
+    process_activate();
+    success = fork_files(parent) && fork_memory(parent);
+  }
+
+  /* Signal the parent.  ARGS is freed once it wakes up. */
+  if (success)
+    pcb->exit_info->process_pid = t->tid;
+  args->success = success;
+  sema_up(&args->done);
+
+  if (!success)
+    fork_abort();
+
+  /* Return to user mode, with fork() returning 0. */
+  if_.eax = 0;
+  thread_charge_cpu(false);
+  asm volatile("movl %0, %%esp; jmp intr_exit" : : "g"(&if_) : "memory");
+  NOT_REACHED();
+}
+
+/* Gives the current process its own handles on PARENT's working
+   directory, executable and open files.  Returns true if
+   successful. */
+static bool fork_files(struct process* parent) {
+  struct process* pcb = thread_current()->pcb;
+  struct list_elem* e;
+  bool success = true;
+
+  pcb->working_dir = dir_reopen(parent->working_dir);
+  pcb->program_file = file_reopen(parent->program_file);
+  if (pcb->working_dir == NULL || pcb->program_file == NULL)
+    return false;
+  file_deny_write(pcb->program_file);
+
+  lock_acquire(&parent->fd_lock);
+  for (e = list_begin(&parent->file_descriptions); e != list_end(&parent->file_descriptions);
+       e = list_next(e)) {
+    struct file_info* pfi = list_entry(e, struct file_info, elem);
+    struct file_info* fi = kmem_cache_alloc(&file_info_cache);
+
+    if (fi == NULL) {
+      success = false;
+      break;
+    }
+    fi->descriptor = pfi->descriptor;
+    fi->is_dir = pfi->is_dir;
+    fi->ref_cnt = 1;
+    if (pfi->is_dir)
+      fi->file = dir_reopen(pfi->file);
+    else {
+      fi->file = file_reopen(pfi->file);
+      if (fi->file != NULL)
+        file_seek(fi->file, file_tell(pfi->file));
+    }
+    if (fi->file == NULL) {
+      kmem_cache_free(&file_info_cache, fi);
+      success = false;
+      break;
+    }
+    rcu_list_push_back(&pcb->file_descriptions, &fi->elem);
+  }
+  pcb->file_count = parent->file_count;
+  lock_release(&parent->fd_lock);
+
+  return success;
+}
+
+/* Copies PARENT's address space into the current process,
+   sharing frames copy-on-write.  Returns true if successful. */
+static bool fork_memory(struct process* parent) {
+  struct process* pcb = thread_current()->pcb;
+  bool success;
+
+  lock_acquire(&parent->pages_lock);
+  lock_acquire(&pcb->pages_lock);
+  success = mmap_fork(parent) && page_table_fork(parent, pcb->program_file);
+  lock_release(&pcb->pages_lock);
+  lock_release(&parent->pages_lock);
+
+  return success;
+}
+
+/* Releases whatever a failed start_fork() managed to set up and
+   exits the thread.  The parent frees the exit info. */
+static void fork_abort(void) {
+  struct thread* t = thread_current();
+  struct process* pcb = t->pcb;
+  uint32_t* pd = pcb->pagedir;
+
+  close_all_files();
+  mmap_unmap_all();
+  page_table_destroy();
+  if (pd != NULL) {
+    pcb->pagedir = NULL;
+    pagedir_activate(NULL);
+    pagedir_destroy(pd);
+  }
+  dir_close(pcb->working_dir);
+  file_close(pcb->program_file);
+
+  t->pcb = NULL;
+  free(pcb);
+  thread_exit();
+}
+#endif
+
 /* Waits for process with PID child_pid to die and returns its exit status.
    If it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If child_pid is invalid or if it was not a
@@ -311,9 +563,11 @@ int process_wait(pid_t child_pid) {
   sema_down(&child_exit_info->death_trigger);
 
   int exit_status;
+  struct rusage child_usage;
   bool free_child = false;
   lock_acquire(&child_exit_info->access_lock);
   exit_status = child_exit_info->exit_code;
+  child_usage = child_exit_info->usage;
   child_exit_info->ref_count -= 1;
   /* free child's exit_info if 0. */
   if (child_exit_info->ref_count == 0) {
@@ -321,11 +575,78 @@ int process_wait(pid_t child_pid) {
   }
   lock_release(&child_exit_info->access_lock);
   if (free_child == true) {
-    free(child_exit_info);
+    kmem_cache_free(&exit_info_cache, child_exit_info);
   }
+
+  // Waiting for a child makes its CPU usage count toward RUSAGE_CHILDREN
+  lock_acquire(&pc_block->children_list_lock);
+  add_usage(&pc_block->child_usage, &child_usage);
+  lock_release(&pc_block->children_list_lock);
   return exit_status;
 }
 
+/* Adds the counts in U to SUM. */
+static void add_usage(struct rusage* sum, const struct rusage* u) {
+  sum->user_cycles += u->user_cycles;
+  sum->kernel_cycles += u->kernel_cycles;
+  sum->wait_cycles += u->wait_cycles;
+  sum->vol_switches += u->vol_switches;
+  sum->invol_switches += u->invol_switches;
+}
+
+/* Adds thread T's CPU usage to the struct rusage at SUM_ if T
+   belongs to the current process. */
+static void add_thread_usage(struct thread* t, void* sum_) {
+  struct rusage* sum = sum_;
+  struct rusage u;
+
+  if (t->pcb == thread_current()->pcb) {
+    thread_get_usage(t, &u);
+    add_usage(sum, &u);
+  }
+}
+
+/* Stores CPU usage in USAGE, for the current process's threads
+   if WHO is RUSAGE_SELF, for the running thread if WHO is
+   RUSAGE_THREAD, or for the children that the process has waited
+   for, and their waited-for children, if WHO is RUSAGE_CHILDREN.
+   Returns false if WHO is none of these. */
+bool process_get_usage(int who, struct rusage* usage) {
+  struct process* pcb = thread_current()->pcb;
+  enum intr_level old_level;
+
+  memset(usage, 0, sizeof *usage);
+  if (who == RUSAGE_SELF) {
+    old_level = intr_disable();
+    thread_foreach(add_thread_usage, usage);
+    intr_set_level(old_level);
+  } else if (who == RUSAGE_THREAD) {
+    old_level = intr_disable();
+    thread_get_usage(thread_current(), usage);
+    intr_set_level(old_level);
+  } else if (who == RUSAGE_CHILDREN) {
+    lock_acquire(&pcb->children_list_lock);
+    *usage = pcb->child_usage;
+    lock_release(&pcb->children_list_lock);
+  } else
+    return false;
+  return true;
+}
+
+/* Closes all of the current process's open files and
+   directories. */
+static void close_all_files(void) {
+  struct process* pcb = thread_current()->pcb;
+
+  lock_acquire(&pcb->fd_lock);
+  while (!list_empty(&pcb->file_descriptions)) {
+    struct list_elem* e = list_front(&pcb->file_descriptions);
+    rcu_list_remove(e);
+    process_put_file(list_entry(e, struct file_info, elem));
+  }
+  lock_release(&pcb->fd_lock);
+}
+
 /* Free the current process's resources. */
 void process_exit(void) {
   struct thread* cur = thread_current();
@@ -337,23 +658,24 @@ void process_exit(void) {
     NOT_REACHED();
   }
 
+  /* Flush buffered output ahead of the exit message. */
+  process_flush_stdout();
+
   /* print exit code. */
   printf("%s: exit(%d)\n", cur->pcb->process_name, cur->pcb->exit_info->exit_code);
 
   /* Close all of the process's opened files. */
-  lock_acquire(&cur->pcb->fd_lock);
-  while (!list_empty(&cur->pcb->file_descriptions)) {
-    struct list_elem* e = list_pop_front (&cur->pcb->file_descriptions);
-    struct file_info* fi = list_entry(e, struct file_info, elem);
-
-    if (fi->is_dir) {
-      dir_close(fi->file);
-    } else {
-      file_close(fi->file);
-    }
-    free(fi);
-  }
-  lock_release(&cur->pcb->fd_lock);
+  close_all_files();
+
+#ifdef VM
+  /* Write back and release memory-mapped files and other pages
+     managed by the supplemental page table.  This must happen
+     while the page directory still records which pages are
+     dirty, and frees frames that other processes may share, so
+     pagedir_destroy() won't see them. */
+  mmap_unmap_all();
+  page_table_destroy();
+#endif
 
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
@@ -398,23 +720,34 @@ void process_exit(void) {
     }
     lock_release(&child_info->access_lock);
     if (deleted) { // need to free after releasing lock since otherwise we would be trying to release a freed lock in memory. 
-      free(child_info);
+      kmem_cache_free(&exit_info_cache, child_info);
     }
   }
 
+  /* Record the CPU usage of this process and its waited-for
+     children for the parent. */
+  struct rusage usage;
+  process_get_usage(RUSAGE_SELF, &usage);
+  add_usage(&usage, &pc_block->child_usage);
+
   /* HANDLE EXIT_INFO */
-  lock_acquire(&pc_block->exit_info->access_lock);
+  struct exit_info* exit_info = pc_block->exit_info;
+  bool free_exit_info;
+  lock_acquire(&exit_info->access_lock);
+  exit_info->usage = usage;
   /* Decrement the reference count */
-  pc_block->exit_info->ref_count -= 1;
-  sema_up(&pc_block->exit_info->death_trigger);
-  /* Free since reference count is 0. */
-  if (pc_block->exit_info->ref_count == 0) {
-    free(pc_block->exit_info);
-  } 
-  if (pc_block->exit_info->ref_count < 0) {
+  exit_info->ref_count -= 1;
+  sema_up(&exit_info->death_trigger);
+  if (exit_info->ref_count < 0) {
     printf("Ref Count < 0 in Process_EXIT. \n");
-  } 
-  lock_release(&pc_block->exit_info->access_lock);
+  }
+  free_exit_info = exit_info->ref_count == 0;
+  lock_release(&exit_info->access_lock);
+  /* Free since reference count is 0.  The cache expects the lock
+     to be released first. */
+  if (free_exit_info) {
+    kmem_cache_free(&exit_info_cache, exit_info);
+  }
   lock_release(&pc_block->children_list_lock);
 
 
@@ -456,12 +789,13 @@ fd_t process_add_file(void* file, bool is_dir) {
   }
 
   // Create the file_info
-  struct file_info* fi = (struct file_info*)calloc(1, sizeof(struct file_info));
+  struct file_info* fi = kmem_cache_alloc(&file_info_cache);
   if (fi == NULL) {
     return -1;
   }
   fi->is_dir = is_dir;
   fi->file = file;
+  fi->ref_cnt = 1;
   fi->elem.next = NULL;
   fi->elem.prev = NULL;
 
@@ -471,7 +805,7 @@ fd_t process_add_file(void* file, bool is_dir) {
   t->pcb->file_count += 1;
 
   // Add to list
-  list_push_back(&t->pcb->file_descriptions, &fi->elem);
+  rcu_list_push_back(&t->pcb->file_descriptions, &fi->elem);
 
   lock_release(&t->pcb->fd_lock);
 
@@ -479,6 +813,8 @@ fd_t process_add_file(void* file, bool is_dir) {
 }
 
 /* Remove the file with the given file descriptor from the process' list.
+   The file is closed once no thread is still using it through
+   process_get_file().
    Returns 0 if it succeeded, -1 if the file was not found or errors. */
 int process_remove_file(fd_t descriptor) {
   struct thread* t = thread_current();
@@ -495,11 +831,10 @@ int process_remove_file(fd_t descriptor) {
 
       // It matches fd, remove it
       if (fi->descriptor == descriptor) {
-        list_remove(e);
+        rcu_list_remove(e);
         lock_release(&t->pcb->fd_lock);
-        // The file_info structs should be entirely handled by process.c,
-        // so free it here and now!
-        free(fi);
+        // Drop the descriptor table's reference; another thread may still hold one
+        process_put_file(fi);
         return 0;
       }
     }
@@ -511,14 +846,17 @@ int process_remove_file(fd_t descriptor) {
 }
 
 /* Get the file identified by the given file descriptor. 
-   Returns NULL if it could not be found. */
+   Returns NULL if it could not be found.  Otherwise the caller
+   holds a reference to the file_info, which keeps it and its file
+   open even if another thread closes the descriptor, and must
+   release it with process_put_file(). */
 struct file_info* process_get_file(fd_t descriptor) {
   struct thread* t = thread_current();
 
   // Thread may not have a PCB yet
   if (t->pcb != NULL) {
-
-    lock_acquire(&t->pcb->fd_lock);
+    // Lookups far outnumber opens and closes, so search as an RCU reader instead of taking fd_lock
+    rcu_read_lock();
 
     struct list_elem* e;
     // Search through all open files
@@ -526,35 +864,110 @@ struct file_info* process_get_file(fd_t descriptor) {
          e = list_next(e)) {
       struct file_info* fi = list_entry(e, struct file_info, elem);
 
-      // It matches fd, return it
+      // It matches fd, return it. Nothing else runs inside a read-side
+      // section, so taking the reference here cannot race process_put_file
       if (fi->descriptor == descriptor) {
-        lock_release(&t->pcb->fd_lock);
+        fi->ref_cnt++;
+        rcu_read_unlock();
         return fi;
       }
     }
 
-    lock_release(&t->pcb->fd_lock);
+    rcu_read_unlock();
   }
 
   return NULL;
 }
 
-/* Check whether the given user virtual address is valid in this process.
-   This checks that:
-     - The address is in the process's memory bounds
-     - The address is in an allocated page. */
-bool process_check_addr(const void* uaddr) {
-  // Is in user virtual space
-  if (is_user_vaddr(uaddr) == false) 
-    return false;
+/* Releases a reference to FI taken by process_get_file().  Once
+   the last reference is gone, closes FI's file or directory and
+   frees FI after the current RCU grace period. */
+void process_put_file(struct file_info* fi) {
+  enum intr_level old_level;
+  bool last;
 
-  struct thread* t = thread_current();
+  old_level = intr_disable();
+  last = --fi->ref_cnt == 0;
+  intr_set_level(old_level);
 
-  // Corresponds to an allocated page
-  if (pagedir_get_page(t->pcb->pagedir, uaddr) == NULL)
-    return false;
+  if (last) {
+    if (fi->is_dir)
+      dir_close(fi->file);
+    else
+      file_close(fi->file);
+    call_rcu(&fi->rcu, free_file_info);
+  }
+}
 
-  return true;
+/* RCU callback that frees the file_info containing HEAD. */
+static void free_file_info(struct rcu_head* head) {
+  kmem_cache_free(&file_info_cache, rcu_entry(head, struct file_info, rcu));
+}
+
+/* Sends whatever is in process P's stdout buffer to the console
+   as a single putbuf().  P's stdout_lock must be held. */
+static void flush_stdout(struct process* p) {
+  ASSERT(lock_held_by_current_thread(&p->stdout_lock));
+  if (p->stdout_len > 0)
+    putbuf(p->stdout_buf, p->stdout_len);
+  p->stdout_len = 0;
+}
+
+/* Writes the SIZE bytes in user buffer UBUF to the current
+   process's standard output.  Returns false if UBUF could not be
+   read, in which case only the bytes before the bad address have
+   been written.
+
+   The bytes are copied into the process's stdout buffer with
+   copy_from_user() before anything touches the console, because
+   putbuf() reads its argument with the console lock held and
+   interrupts off, where a page fault must not happen.  The
+   buffer is sent to the console as a single putbuf() once it
+   holds a full line, once it fills up, or when the process
+   flushes it explicitly.  This turns the stream of short writes
+   that user printf() produces into a few console transactions,
+   and sends large writes through in buffer-sized pieces, in
+   order. */
+bool process_write_stdout(const char* ubuf, size_t size) {
+  struct process* p = thread_current()->pcb;
+  bool success = true;
+
+  lock_acquire(&p->stdout_lock);
+  while (size > 0) {
+    char* dst = p->stdout_buf + p->stdout_len;
+    size_t chunk = STDOUT_BUF_SIZE - p->stdout_len;
+    if (chunk > size)
+      chunk = size;
+
+    if (!copy_from_user(dst, ubuf, chunk)) {
+      success = false;
+      break;
+    }
+    p->stdout_len += chunk;
+    ubuf += chunk;
+    size -= chunk;
+
+    if (p->stdout_len == STDOUT_BUF_SIZE || memchr(dst, '\n', chunk) != NULL)
+      flush_stdout(p);
+  }
+  lock_release(&p->stdout_lock);
+  return success;
+}
+
+/* Sends any output the current process has buffered for its
+   standard output to the console.  Called wherever the process
+   may be about to wait on, or be overtaken by, other console
+   output: before reading standard input, before exec and wait,
+   and on exit. */
+void process_flush_stdout(void) {
+  struct process* p = thread_current()->pcb;
+
+  if (p == NULL)
+    return;
+
+  lock_acquire(&p->stdout_lock);
+  flush_stdout(p);
+  lock_release(&p->stdout_lock);
 }
 
 /* We load ELF binaries.  The following definitions are taken
@@ -732,7 +1145,10 @@ done:
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page(void* upage, void* kpage, bool writable);
+static bool install_large_page(void* upage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -797,6 +1213,33 @@ static bool load_segment(struct file* file, off_t ofs, uint8_t* upage, uint32_t
   ASSERT(pg_ofs(upage) == 0);
   ASSERT(ofs % PGSIZE == 0);
 
+#ifdef VM
+  /* Record each page in the supplemental page table and let
+     page_fault() read it in the first time it is touched.  Pages
+     that lie entirely past the segment's file data never touch
+     the file at all. */
+  struct lock* pages_lock = &thread_current()->pcb->pages_lock;
+  bool success = true;
+
+  lock_acquire(pages_lock);
+  while (success && (read_bytes > 0 || zero_bytes > 0)) {
+    size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+    size_t page_zero_bytes = PGSIZE - page_read_bytes;
+
+    if (page_read_bytes > 0)
+      success = page_add_exec(upage, file, ofs, page_read_bytes, writable) != NULL;
+    else
+      success = page_add_zero(upage, writable) != NULL;
+
+    /* Advance. */
+    read_bytes -= page_read_bytes;
+    zero_bytes -= page_zero_bytes;
+    ofs += page_read_bytes;
+    upage += PGSIZE;
+  }
+  lock_release(pages_lock);
+  return success;
+#else
   file_seek(file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) {
     /* Calculate how to fill this page.
@@ -805,6 +1248,16 @@ static bool load_segment(struct file* file, off_t ofs, uint8_t* upage, uint32_t
     size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
     size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+    /* With -ulpages, zero-filled stretches that cover whole 4 MB
+       aligned regions get one large page per region, so that big
+       arrays do not thrash the TLB. */
+    if (user_large_pages && read_bytes == 0 && zero_bytes >= LPGSIZE &&
+        ((uintptr_t)upage & LPGMASK) == 0 && install_large_page(upage, writable)) {
+      zero_bytes -= LPGSIZE;
+      upage += LPGSIZE;
+      continue;
+    }
+
     /* Get a page of memory. */
     uint8_t* kpage = palloc_get_page(PAL_USER);
     if (kpage == NULL)
@@ -829,15 +1282,26 @@ static bool load_segment(struct file* file, off_t ofs, uint8_t* upage, uint32_t
     upage += PGSIZE;
   }
   return true;
+#endif
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
    user virtual memory. */
 static bool setup_stack(void** esp, int argc, const char* const* argv) {
-  uint8_t* kpage;
   bool success = false;
 
-  kpage = palloc_get_page(PAL_USER | PAL_ZERO);
+#ifdef VM
+  /* The page faults in, zeroed, as the arguments are pushed.
+     The stack grows below it on demand, up to the process's
+     stack limit. */
+  struct lock* pages_lock = &thread_current()->pcb->pages_lock;
+  lock_acquire(pages_lock);
+  success = page_add_zero(((uint8_t*)PHYS_BASE) - PGSIZE, true) != NULL;
+  lock_release(pages_lock);
+  if (success)
+    *esp = PHYS_BASE;
+#else
+  uint8_t* kpage = palloc_get_page(PAL_USER | PAL_ZERO);
   if (kpage != NULL) {
     success = install_page(((uint8_t*)PHYS_BASE) - PGSIZE, kpage, true);
     if (success)
@@ -846,6 +1310,7 @@ static bool setup_stack(void** esp, int argc, const char* const* argv) {
       // Exit prematurely if unsucessful
       palloc_free_page(kpage);
   }
+#endif
 
   if (success) {
     /* ARG PARSING LOGIC */
@@ -912,6 +1377,7 @@ static bool setup_stack(void** esp, int argc, const char* const* argv) {
   return success;
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -930,6 +1396,26 @@ static bool install_page(void* upage, void* kpage, bool writable) {
           pagedir_set_page(t->pcb->pagedir, upage, kpage, writable));
 }
 
+/* Maps a zeroed 4 MB large page at user virtual address UPAGE,
+   which must be 4 MB aligned.  If WRITABLE is true, the user
+   process may modify it; otherwise, it is read-only.  Returns
+   true on success, false if part of the region is already
+   mapped or no suitably aligned run of user pages is free, in
+   which case the caller can still map the region page by page. */
+static bool install_large_page(void* upage, bool writable) {
+  struct thread* t = thread_current();
+  void* kpage = palloc_get_aligned(PAL_USER | PAL_ZERO, LPGPAGES, LPGPAGES);
+
+  if (kpage == NULL)
+    return false;
+  if (!pagedir_set_large_page(t->pcb->pagedir, upage, kpage, writable)) {
+    palloc_free_multiple(kpage, LPGPAGES);
+    return false;
+  }
+  return true;
+}
+#endif
+
 /* Returns true if t is the main thread of the process p */
 bool is_main_thread(struct thread* t, struct process* p) { return p->main_thread == t; }
 
@@ -5,6 +5,10 @@
 #include "threads/thread.h"
 #include <stdint.h>
 #include "list.h"
+#ifdef VM
+#include <hash.h>
+#include "vm/mmap.h"
+#endif
 
 // At most 8MB can be allocated to the stack
 // These defines will be used in Project 2: Multithreading
@@ -14,6 +18,9 @@
 // Maximum number of arguments per command/process
 #define MAX_ARGS 127
 
+// Size of the kernel-side buffer for each process's standard output
+#define STDOUT_BUF_SIZE 256
+
 /* PIDs and TIDs are the same type. PID should be
    the TID of the main thread of the process */
 typedef tid_t pid_t;
@@ -30,6 +37,7 @@ struct exit_info {
    struct semaphore death_trigger; /* Semaphore to notify parents of death. Initialized to 0. */
    struct lock access_lock; /* Lock to ensure only one thread can read/write to exit_info at a time. */
    struct list_elem elem; /* Allows us to use this struct in a Pintos list. */
+   struct rusage usage; /* CPU usage of the process and its waited-for children, set on exit. */
 };
 
 /* File descriptors. */
@@ -40,8 +48,10 @@ struct file_info {
    void* file;       /* Open file description for low level operations. */
    fd_t descriptor;  /* File descriptor to reference this open file. */
    bool is_dir;      /* Whether this refers to a file or a directory. */
+   int ref_cnt;      /* One for the descriptor table, plus one per unreleased process_get_file(). */
 
    struct list_elem elem;  /* Allows file_info to be held in a linked list. */
+   struct rcu_head rcu;    /* Frees the file_info once it is closed. */
 };
 
 /* The process control block for a given process. Since
@@ -59,6 +69,7 @@ struct process {
   pid_t parent_pid; /* Pid of the parent process. */
   struct list children_exit_infos; /* list of children exit info. */
   struct lock children_list_lock; /* Lock to ensure only one thread can modify the children_exit_infos list at a time. */
+  struct rusage child_usage; /* CPU usage of waited-for children. Protected by children_list_lock. */
 
   struct file* program_file; /* Keep open the program's file. */
   struct dir* working_dir;   /* Keep open the current working directory. */
@@ -67,11 +78,34 @@ struct process {
   int file_count;                /* Number of descriptors ever opened. */
   struct lock fd_lock;           /* Lock to ensure the file_descriptions and file_count can only be modified once at a time. */
 
+  char stdout_buf[STDOUT_BUF_SIZE]; /* Output written to STDOUT but not yet sent to the console. */
+  size_t stdout_len;                /* Number of bytes in stdout_buf. */
+  struct lock stdout_lock;          /* Lock to ensure threads append to stdout_buf one at a time. */
+
+#ifdef VM
+  struct hash pages;       /* Supplemental page table (see vm/page.c). */
+  struct list mappings;    /* Memory-mapped files (see vm/mmap.c). */
+  mapid_t next_mapid;      /* Identifier for the next memory mapping. */
+  struct lock pages_lock;  /* Lock to ensure pages and mappings are modified once at a time. */
+  size_t stack_limit;      /* Most pages the user stack may grow to. */
+#endif
+
 };
 
+#ifndef VM
+/* Map large zero-filled regions of user programs with 4 MB pages?
+   Set by the kernel's -ulpages option. */
+extern bool user_large_pages;
+#endif
+
 void userprog_init(void);
 
+struct intr_frame;
+
 pid_t process_execute(const char* cmd_line);
+#ifdef VM
+pid_t process_fork(const struct intr_frame*);
+#endif
 int process_wait(pid_t);
 void process_exit(void);
 void process_activate(void);
@@ -79,8 +113,12 @@ void process_activate(void);
 fd_t process_add_file(void* file, bool is_dir);
 int process_remove_file(fd_t descriptor);
 struct file_info* process_get_file(fd_t descriptor);
+void process_put_file(struct file_info* fi);
+
+bool process_write_stdout(const char* ubuf, size_t size);
+void process_flush_stdout(void);
 
-bool process_check_addr(const void* uaddr);
+bool process_get_usage(int who, struct rusage*);
 
 bool is_main_thread(struct thread*, struct process*);
 pid_t get_pid(struct process*);
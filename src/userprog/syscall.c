@@ -11,12 +11,20 @@
 #include "filesys/directory.h"
 #include "filesys/inode.h"
 #include "devices/input.h"
-#include "filesys/inode.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "userprog/uaccess.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 #include "lib/float.h"
 
+static void copy_in_args(uint32_t* args, const uint32_t* uargs, int cnt);
 static void check_buf_bounds(const void* ptr, uint32_t size);
-static void check_str_bounds(const char* str);
+static void check_buf_writable(void* ptr, uint32_t size);
+static char* copy_in_string(const char* str);
 
 static void syscall_handler(struct intr_frame*);
 
@@ -24,55 +32,77 @@ void syscall_init(void) {
   intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
-/* Verifies that the buffer pointed to by PTR of given SIZE is within 
-   the user memory bounds. 
-   
+/* Copies the system call number and the arguments after it, CNT
+   words in all, from the user stack at UARGS into ARGS.  The copy
+   cannot fault in the kernel even if the stack is unmapped
+   meanwhile.
+
+   This immediately terminates the process if the words are not all
+   mapped. */
+static void copy_in_args(uint32_t* args, const uint32_t* uargs, int cnt) {
+  if (!copy_from_user(args, uargs, cnt * sizeof *args)) {
+    // Segmentation fault
+    process_exit();
+  }
+}
+
+/* Verifies that the buffer pointed to by PTR of given SIZE is
+   mapped user memory.  This costs one probe per page spanned by
+   the buffer, not one page table walk per byte.
+
    This immediately terminates the process if the pointer is invalid. */
 static void check_buf_bounds(const void* ptr, uint32_t size) {
-  bool result = (ptr != NULL
-                 // Check both the start and ending addresses of the buffer
-                 && process_check_addr(ptr) && process_check_addr(ptr + size - 1));
-  if (result == false) {
+  if (ptr == NULL || !check_user(ptr, size, false)) {
     // Segmentation fault
     process_exit();
   }
 }
 
-/* Verifies that the string pointed to by PTR is within the user memory bounds.
-   
-   This immediately terminates the process if the string is invalid. */
-static void check_str_bounds(const char* str) {
-  bool result = str != NULL && process_check_addr(str);
-
-  // Pointer to string is good, let's check the content
-  if (result) {
-    int i = 0;
-    for (;;) {
-      // Make sure the char at this index is valid
-      if (process_check_addr(str + i) == false) {
-        result = false;
-        break;
-      }
+/* Verifies that the buffer pointed to by PTR of given SIZE is
+   mapped, writable user memory, so that the kernel may store
+   into it.
 
-      // Stop on null terminators
-      if (str[i] == '\0')
-        break;
-
-      i += 1;
-    }
+   This immediately terminates the process if the pointer is invalid. */
+static void check_buf_writable(void* ptr, uint32_t size) {
+  if (ptr == NULL || !check_user(ptr, size, true)) {
+    // Segmentation fault
+    process_exit();
   }
+}
+
+/* Copies the string pointed to by STR into a freshly allocated
+   page, which the caller must free with palloc_free_page().
+   Returns a null pointer if the string, including its null
+   terminator, does not fit in a page or if no page is available.
+
+   This immediately terminates the process if the string is invalid. */
+static char* copy_in_string(const char* str) {
+  char* kstr = palloc_get_page(0);
+  if (kstr == NULL)
+    return NULL;
 
-  if (result == false) {
+  int len = strncpy_from_user(kstr, str, PGSIZE);
+  if (len < 0) {
     // Segmentation fault
+    palloc_free_page(kstr);
     process_exit();
   }
+  if (len == PGSIZE) {
+    palloc_free_page(kstr);
+    return NULL;
+  }
+  return kstr;
 }
 
 static void syscall_handler(struct intr_frame* f UNUSED) {
-  uint32_t* args = ((uint32_t*)f->esp);
+  const uint32_t* uargs = ((const uint32_t*)f->esp);
+  uint32_t args[4];
+
+  // Faults on user memory during the call need this to tell stack growth from bad accesses
+  thread_current()->user_esp = f->esp;
 
-  // Check that there is at least 1 argument in the args (i.e. the syscall code)
-  check_buf_bounds(args, sizeof(uint32_t));
+  // Copy in the syscall code; each call copies in its own arguments below
+  copy_in_args(args, uargs, 1);
 
   /*
    * The following print statement, if uncommented, will print out the syscall
@@ -82,7 +112,7 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
    */
 
   if (args[0] == SYS_EXIT) {
-    check_buf_bounds(&args[1], 1 * 4);
+    copy_in_args(args, uargs, 1 + 1);
 
     int exit_code = (int)args[1];
     f->eax = exit_code;
@@ -94,55 +124,61 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
     lock_release(&p->exit_info->access_lock);
     process_exit();
   } else if (args[0] == SYS_PRACTICE) {
-    check_buf_bounds(&args[1], 1 * 4);
+    copy_in_args(args, uargs, 1 + 1);
     f->eax = args[1] + 1;
   } else if (args[0] == SYS_HALT) {
+    process_flush_stdout();
     // imported from devices/shutdown.h
     shutdown_power_off();
   } else if (args[0] == SYS_EXEC) {
-    check_buf_bounds(&args[1], 1 * 4);
+    copy_in_args(args, uargs, 1 + 1);
+
+    char* cmd_line = copy_in_string((const char*)args[1]);
 
-    const char* cmd_line = (const char*)args[1];
-    check_str_bounds(cmd_line);
+    // The child's output must not overtake ours
+    process_flush_stdout();
 
-    pid_t ret;
-    ret = process_execute(cmd_line);
+    pid_t ret = TID_ERROR;
+    if (cmd_line != NULL)
+      ret = process_execute(cmd_line);
+    palloc_free_page(cmd_line);
     f->eax = ret;
   } else if (args[0] == SYS_WAIT) {
+    copy_in_args(args, uargs, 1 + 1);
+
     pid_t child_pid = (pid_t)args[1];
+    process_flush_stdout();
     int ret = process_wait(child_pid);
     f->eax = ret;
   } else if (args[0] == SYS_CREATE) {
     // Check the syscall args (2 arguments, 4 bytes each)
-    check_buf_bounds(&args[1], 2 * 4);
+    copy_in_args(args, uargs, 1 + 2);
 
-    const char* filename = (const char*)args[1];
-    check_str_bounds(filename);
+    char* filename = copy_in_string((const char*)args[1]);
     uint32_t initial_size = args[2];
 
-
-    bool result = filesys_create(filename, initial_size);
+    bool result = filename != NULL && filesys_create(filename, initial_size);
+    palloc_free_page(filename);
     f->eax = result;
 
   } else if (args[0] == SYS_REMOVE) {
     // Check the syscall args (1 arguments, 4 bytes each)
-    check_buf_bounds(&args[1], 1 * 4);
+    copy_in_args(args, uargs, 1 + 1);
 
-    const char* filename = (const char*)args[1];
-    check_str_bounds(filename);
+    char* filename = copy_in_string((const char*)args[1]);
 
-    bool result = filesys_remove(filename);
+    bool result = filename != NULL && filesys_remove(filename);
+    palloc_free_page(filename);
     f->eax = result;
   } else if (args[0] == SYS_OPEN) {
     // Check the syscall args (1 arguments, 4 bytes each)
-    check_buf_bounds(&args[1], 1 * 4);
+    copy_in_args(args, uargs, 1 + 1);
 
-    const char* filename = (const char*)args[1];
-    check_str_bounds(filename);
+    char* filename = copy_in_string((const char*)args[1]);
 
     bool is_dir = false;
     // Check if file exists
-    if (filesys_lookup(filename, &is_dir)) {
+    if (filename != NULL && filesys_lookup(filename, &is_dir)) {
       // Check if it's a dir (or file)
       if (is_dir) {
         // Attempt opening the dir
@@ -170,43 +206,26 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
     else {
       f->eax = -1;
     }
-    
+    palloc_free_page(filename);
+
   } else if (args[0] == SYS_CLOSE) {
     // Check the syscall args (1 arguments, 4 bytes each)
-    check_buf_bounds(&args[1], 1 * 4);
+    copy_in_args(args, uargs, 1 + 1);
 
     // No need to check fd arg, it's just an int
-    // Also process_get_file will just error if it's invalid
+    // Also process_remove_file will just error if it's invalid
     fd_t fd = (fd_t)args[1];
 
-    struct file_info* fi = process_get_file(fd);
-    if (fi == NULL) {
-      // File not found with given fd
-      f->eax = -1;
-    } else {
-      if (fi->is_dir) {
-        dir_close((struct dir*)fi->file);
-      } else {
-        file_close((struct file*)fi->file);
-      }
-      int result = process_remove_file(fd);
-      if (result == -1) {
-        // We previously found a file with the fd (when calling get_file)
-        // but now that we're trying to remove it, it no longer exists?
-        // Something has gone seriously wrong!
-        PANIC("Invalid process state; could not remove a file description which we previously had "
-              "a hold of.");
-      }
-      f->eax = 0;
-    }
+    // The file itself is closed once no other thread is still using it
+    f->eax = process_remove_file(fd);
   } else if (args[0] == SYS_READ) {
     // Check the syscall args (3 arguments, 4 bytes each)
-    check_buf_bounds(&args[1], 3 * 4);
+    copy_in_args(args, uargs, 1 + 3);
 
     fd_t fd = (fd_t)args[1];
     char* buf = (char*)args[2];
     off_t buf_size = (off_t)args[3];
-    check_buf_bounds(buf, buf_size);
+    check_buf_writable(buf, buf_size);
 
 
     // Attempt to get file
@@ -214,11 +233,15 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
 
     // Target is standard input
     if (fd == STDIN_FILENO) {
+      // Make sure any prompt reaches the console before we wait for input
+      process_flush_stdout();
+
       off_t num_read;
       char c;
       for (num_read = 0; num_read < buf_size; num_read++) {
         c = input_getc();
-        buf[num_read] = c;
+        if (!copy_to_user(&buf[num_read], &c, 1))
+          process_exit();
 
         // Check for end of input
         if (c == '\n')
@@ -230,16 +253,28 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
     }
     // Target is a file
     else if (fi != NULL && fi->is_dir == false) {
+#ifdef VM
+      // The file system copies into the buffer while holding its locks, so it must not fault
+      if (!page_pin(buf, buf_size, true)) {
+        process_put_file(fi);
+        process_exit();
+      }
+#endif
       f->eax = file_read((struct file*)fi->file, buf, buf_size);
+#ifdef VM
+      page_unpin(buf, buf_size);
+#endif
     }
     // Error occured
     else {
       f->eax = -1;
     }
+    if (fi != NULL)
+      process_put_file(fi);
 
   } else if (args[0] == SYS_WRITE) {
     // Check the syscall args (3 arguments, 4 bytes each)
-    check_buf_bounds(&args[1], 3 * 4);
+    copy_in_args(args, uargs, 1 + 3);
 
     fd_t fd = (fd_t)args[1];
     const char* buf = (const char*)args[2];
@@ -252,33 +287,34 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
     
     // Target is standard output
     if (fd == STDOUT_FILENO) {
-      // Make copy of buf size
-      off_t remaining_buf = buf_size;
-
-      // Split output
-      while (remaining_buf > MAX_BUF_LENGTH) {
-        putbuf(buf, MAX_BUF_LENGTH);
-        remaining_buf -= MAX_BUF_LENGTH;
-      }
-
-      if (remaining_buf > 0) {
-        putbuf(buf, remaining_buf);
-      }
-
+      if (!process_write_stdout(buf, buf_size))
+        process_exit();
       f->eax = buf_size;
     }
     // Target is a file
     else if (fi != NULL && fi->is_dir == false) {
+#ifdef VM
+      // The file system copies from the buffer while holding its locks, so it must not fault
+      if (!page_pin(buf, buf_size, false)) {
+        process_put_file(fi);
+        process_exit();
+      }
+#endif
       f->eax = file_write((struct file*)fi->file, buf, buf_size);
+#ifdef VM
+      page_unpin(buf, buf_size);
+#endif
     }
     // Error occured
     else {
       f->eax = -1;
     }
+    if (fi != NULL)
+      process_put_file(fi);
 
   } else if (args[0] == SYS_FILESIZE) {
     // Check the syscall args (1 arguments, 4 bytes each)
-    check_buf_bounds(&args[1], 1 * 4);
+    copy_in_args(args, uargs, 1 + 1);
 
     fd_t fd = (fd_t)args[1];
 
@@ -290,13 +326,14 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
       } else {
         f->eax = file_length((struct file*)fi->file);
       }
+      process_put_file(fi);
     } else {
       f->eax = -1;
     }
 
   } else if (args[0] == SYS_SEEK) {
     // Check the syscall args (2 arguments, 4 bytes each)
-    check_buf_bounds(&args[1], 2 * 4);
+    copy_in_args(args, uargs, 1 + 2);
 
     fd_t fd = (fd_t)args[1];
     off_t position = (off_t)args[2];
@@ -307,10 +344,12 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
     if (fi != NULL && fi->is_dir == false) {
       file_seek((struct file*)fi->file, position);
     }
+    if (fi != NULL)
+      process_put_file(fi);
 
   } else if (args[0] == SYS_TELL) {
     // Check the syscall args (1 arguments, 4 bytes each)
-    check_buf_bounds(&args[1], 1 * 4);
+    copy_in_args(args, uargs, 1 + 1);
 
     fd_t fd = (fd_t)args[1];
 
@@ -321,55 +360,93 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
     } else {
       f->eax = -1;
     }
+    if (fi != NULL)
+      process_put_file(fi);
 
+#ifdef VM
+  } else if (args[0] == SYS_MMAP) {
+    // Check the syscall args (2 arguments, 4 bytes each)
+    copy_in_args(args, uargs, 1 + 2);
+
+    fd_t fd = (fd_t)args[1];
+    void* addr = (void*)args[2];
+
+    // Only regular files can be mapped
+    struct file_info* fi = process_get_file(fd);
+    mapid_t ret = MAP_FAILED;
+    if (fi != NULL && !fi->is_dir)
+      ret = mmap_map((struct file*)fi->file, addr);
+    if (fi != NULL)
+      process_put_file(fi);
+    f->eax = ret;
+
+  } else if (args[0] == SYS_MUNMAP) {
+    // Check the syscall args (1 argument, 4 bytes each)
+    copy_in_args(args, uargs, 1 + 1);
+
+    mmap_unmap((mapid_t)args[1]);
+#endif
+  } else if (args[0] == SYS_FORK) {
+#ifdef VM
+    f->eax = process_fork(f);
+#else
+    // Copy-on-write fork needs the supplemental page table
+    f->eax = TID_ERROR;
+#endif
   } else if (args[0] == SYS_MKDIR) {
     // Check the syscall args (1 arguments, 4 bytes each)
-    check_buf_bounds(&args[1], 1 * 4);
+    copy_in_args(args, uargs, 1 + 1);
 
-    const char* dirname = (const char*)args[1];
-    check_str_bounds(dirname);
+    char* dirname = copy_in_string((const char*)args[1]);
 
-    
-    bool result = filesys_mkdir(dirname);
+    bool result = dirname != NULL && filesys_mkdir(dirname);
+    palloc_free_page(dirname);
     f->eax = result;
 
   } else if (args[0] == SYS_ISDIR) {
     // Check the syscall args (1 arguments, 4 bytes each)
-    check_buf_bounds(&args[1], 1 * 4);
+    copy_in_args(args, uargs, 1 + 1);
 
     fd_t fd = (fd_t)args[1];
 
 
     struct file_info* fi = process_get_file(fd);
     f->eax = fi != NULL && fi->is_dir;
+    if (fi != NULL)
+      process_put_file(fi);
 
   } else if (args[0] == SYS_READDIR) {
     // Check the syscall args (2 arguments, 4 bytes each)
-    check_buf_bounds(&args[1], 2 * 4);
+    copy_in_args(args, uargs, 1 + 2);
 
     fd_t fd = (fd_t)args[1];
     char* name = (char*)args[2];
-
+    char kname[NAME_MAX + 1];
 
     struct file_info* fi = process_get_file(fd);
     if (fi != NULL && fi->is_dir) {
       do {
-        f->eax = dir_readdir((struct dir*)fi->file, name);
+        f->eax = dir_readdir((struct dir*)fi->file, kname);
         // Don't want to list out . and .. so keep going if that's what we got
-      } while (f->eax && (strcmp(name, ".") == 0 || strcmp(name, "..") == 0));
+      } while (f->eax && (strcmp(kname, ".") == 0 || strcmp(kname, "..") == 0));
+      if (f->eax && !copy_to_user(name, kname, strlen(kname) + 1)) {
+        process_put_file(fi);
+        process_exit();
+      }
     } else {
       f->eax = false;
     }
+    if (fi != NULL)
+      process_put_file(fi);
 
   }  else if (args[0] == SYS_CHDIR) {
     // Check the syscall args (1 arguments, 4 bytes each)
-    check_buf_bounds(&args[1], 1 * 4);
+    copy_in_args(args, uargs, 1 + 1);
 
-    const char* dirname = (const char*)args[1];
-    check_str_bounds(dirname);
+    char* dirname = copy_in_string((const char*)args[1]);
 
-    
-    struct dir* new_cwd = filesys_open_dir(dirname);
+    struct dir* new_cwd = dirname != NULL ? filesys_open_dir(dirname) : NULL;
+    palloc_free_page(dirname);
     if (new_cwd != NULL) {
       struct thread* t = thread_current();
       // Swap old and new cwd
@@ -385,7 +462,7 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
 
   } else if (args[0] == SYS_INUMBER) {
     // Check the syscall args (1 arguments, 4 bytes each)
-    check_buf_bounds(&args[1], 1 * 4);
+    copy_in_args(args, uargs, 1 + 1);
 
     fd_t fd = (fd_t)args[1];
 
@@ -398,11 +475,14 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
       else {
         f->eax = inode_get_inumber(file_get_inode((struct file*)fi->file));
       }
+      process_put_file(fi);
     } else {
       f->eax = -1;
     }
 
   } else if (args[0] == SYS_COMPUTE_E) {
+    copy_in_args(args, uargs, 1 + 1);
+
     int n = args[1];
 
     if (n > 0) {
@@ -416,5 +496,16 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
     f->eax = get_num_hit();
   } else if (args[0] == SYS_WRITE_COUNT) {
     f->eax = block_write_count(fs_device);
+  } else if (args[0] == SYS_GETRUSAGE) {
+    // Check the syscall args (2 arguments, 4 bytes each)
+    copy_in_args(args, uargs, 1 + 2);
+
+    int who = (int)args[1];
+    struct rusage* usage = (struct rusage*)args[2];
+
+    struct rusage ku;
+    f->eax = process_get_usage(who, &ku);
+    if (f->eax && !copy_to_user(usage, &ku, sizeof ku))
+      process_exit();
   }
 }
@@ -0,0 +1,103 @@
+#include "userprog/uaccess.h"
+#include <debug.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/vaddr.h"
+
+/* Accessing user memory.
+
+   Rather than walking the page directory to validate every user
+   pointer before touching it, the kernel checks only that an
+   access lies entirely below PHYS_BASE and then just performs
+   it.  If a user page turns out to be unmapped, the access page
+   faults inside one of the routines in usercopy.S and
+   page_fault() calls uaccess_fixup(), which makes the routine
+   return failure.  Validating a buffer therefore costs one range
+   check plus, at most, one fault, no matter how many pages it
+   spans. */
+
+/* Routines and labels in usercopy.S. */
+int usercopy(void* dst, const void* src, size_t size);
+int usercopy_str(char* dst, const char* src, size_t size);
+int usercopy_probe(const void* uaddr, int write);
+extern char usercopy_begin, usercopy_end, usercopy_fault;
+
+/* Returns true if the SIZE bytes starting at UADDR lie entirely
+   within user virtual memory, false otherwise. */
+static bool range_ok(const void* uaddr, size_t size) {
+  uintptr_t start = (uintptr_t)uaddr;
+  uintptr_t end = start + size;
+
+  return end >= start && end <= (uintptr_t)PHYS_BASE;
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address
+   DST.  Returns true if successful, false if any part of the
+   source is not mapped user memory. */
+bool copy_from_user(void* dst, const void* usrc, size_t size) {
+  return range_ok(usrc, size) && usercopy(dst, usrc, size) == 0;
+}
+
+/* Copies SIZE bytes from kernel address SRC to user address
+   UDST.  Returns true if successful, false if any part of the
+   destination is not mapped, writable user memory. */
+bool copy_to_user(void* udst, const void* src, size_t size) {
+  return range_ok(udst, size) && usercopy(udst, src, size) == 0;
+}
+
+/* Copies the null-terminated string at user address USRC into
+   the SIZE-byte kernel buffer DST.  Returns the length of the
+   string, not counting the null terminator, if the whole string
+   fit.  Returns SIZE if no terminator was found in the first
+   SIZE bytes, in which case DST is not null-terminated.  Returns
+   -1 if the string runs into unmapped memory. */
+int strncpy_from_user(char* dst, const char* usrc, size_t size) {
+  size_t max_size;
+
+  if (!is_user_vaddr(usrc))
+    return -1;
+
+  /* Never read past the top of user memory.  If the string
+     would continue there, it is not a valid user string. */
+  max_size = (uintptr_t)PHYS_BASE - (uintptr_t)usrc;
+  if (size > max_size) {
+    int len = usercopy_str(dst, usrc, max_size);
+    return len == (int)max_size ? -1 : len;
+  }
+  return usercopy_str(dst, usrc, size);
+}
+
+/* Verifies that the SIZE bytes starting at user address UADDR
+   are mapped, and writable as well if WRITE is true.  Touches
+   one byte per page, so pages that are mapped lazily are brought
+   in as a side effect.  Returns true if the whole range is
+   accessible, false otherwise. */
+bool check_user(const void* uaddr, size_t size, bool write) {
+  const uint8_t* p;
+  const uint8_t* end = (const uint8_t*)uaddr + size;
+
+  if (!range_ok(uaddr, size))
+    return false;
+  if (size == 0)
+    return true;
+
+  for (p = uaddr; p < end; p = pg_round_down(p) + PGSIZE)
+    if (usercopy_probe(p, write) != 0)
+      return false;
+  return true;
+}
+
+/* Called by page_fault() for faults in kernel context.  If the
+   fault happened while one of the routines in usercopy.S was
+   accessing user memory, arranges for that routine to return
+   failure and returns true.  Returns false for any other fault,
+   which is then a kernel bug. */
+bool uaccess_fixup(struct intr_frame* f) {
+  uintptr_t eip = (uintptr_t)f->eip;
+
+  if (eip < (uintptr_t)&usercopy_begin || eip >= (uintptr_t)&usercopy_end)
+    return false;
+
+  f->eip = (void (*)(void)) & usercopy_fault;
+  return true;
+}
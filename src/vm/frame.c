@@ -0,0 +1,481 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* Frames holding file data, keyed by inode and offset. */
+static struct hash shared_frames;
+
+/* Every frame, in the order the clock hand sweeps them. */
+static struct list frame_table;
+
+/* Next frame the clock hand considers for eviction. */
+static struct list_elem* clock_hand;
+
+/* Protects shared_frames, frame_table and clock_hand, and the
+   reference counts, pin counts and page lists of the frames. */
+static struct lock frame_lock;
+
+static hash_hash_func frame_hash;
+static hash_less_func frame_less;
+static struct frame* frame_find(struct frame* key);
+static struct frame* frame_get_shared(struct frame*);
+static void frame_table_insert(struct frame*);
+static void frame_table_remove(struct frame*);
+static void frame_free(struct frame*);
+static void* get_user_page(void);
+static void* evict(void);
+static struct frame* choose_victim(size_t* slot);
+static bool lock_owners(struct frame*);
+static void unlock_owners(struct frame*);
+static bool test_and_clear_accessed(struct frame*);
+
+/* Initializes the frame table. */
+void frame_init(void) {
+  hash_init(&shared_frames, frame_hash, frame_less, NULL);
+  list_init(&frame_table);
+  clock_hand = list_end(&frame_table);
+  lock_init_named(&frame_lock, "frame_lock");
+}
+
+/* Returns a new frame from the user pool for a page that does
+   not share it, evicting another frame if the pool is empty, or
+   a null pointer if no frame can be had.  Its contents are
+   undefined.  The frame is returned pinned: once the caller has
+   mapped it with frame_map(), it should unpin it, and otherwise
+   give it back with frame_release(). */
+struct frame* frame_alloc(void) {
+  struct frame* f = malloc(sizeof *f);
+  if (f == NULL)
+    return NULL;
+
+  f->kpage = get_user_page();
+  if (f->kpage == NULL) {
+    free(f);
+    return NULL;
+  }
+  f->inode = NULL;
+  f->ofs = 0;
+  f->read_bytes = 0;
+  f->text = false;
+  f->ref_cnt = 1;
+  lock_init(&f->load_lock);
+  list_init(&f->pages);
+  f->pin_cnt = 1;
+
+  lock_acquire(&frame_lock);
+  frame_table_insert(f);
+  lock_release(&frame_lock);
+
+  return f;
+}
+
+/* Returns a frame holding the first READ_BYTES bytes of the page
+   of INODE that starts at byte offset OFS, which must be
+   page-aligned, followed by zeros.  TEXT is true for read-only
+   program text, false for a memory-mapped file.  If another page
+   already maps the same data in the same way, its frame is
+   shared and nothing is read.  Otherwise a new frame is
+   allocated as by frame_alloc() and filled through the buffer
+   cache.  Returns a null pointer if no frame can be had.
+
+   The frame is returned pinned, as by frame_alloc(). */
+struct frame* frame_get_file(struct inode* inode, off_t ofs, size_t read_bytes, bool text) {
+  struct frame key;
+  struct frame* f;
+  struct frame* other;
+  void* kpage;
+  off_t n;
+
+  ASSERT(ofs % PGSIZE == 0);
+  ASSERT(read_bytes <= PGSIZE);
+
+  key.inode = inode;
+  key.ofs = ofs;
+  key.read_bytes = read_bytes;
+  key.text = text;
+
+  lock_acquire(&frame_lock);
+  f = frame_find(&key);
+  if (f != NULL)
+    return frame_get_shared(f);
+  lock_release(&frame_lock);
+
+  /* Getting a page may mean evicting a frame, which must not
+     happen under frame_lock.  Someone else may read in the same
+     data meanwhile, so look again afterward. */
+  f = malloc(sizeof *f);
+  kpage = f != NULL ? get_user_page() : NULL;
+  if (kpage == NULL) {
+    free(f);
+    return NULL;
+  }
+
+  lock_acquire(&frame_lock);
+  other = frame_find(&key);
+  if (other != NULL) {
+    palloc_free_page(kpage);
+    free(f);
+    return frame_get_shared(other);
+  }
+  f->kpage = kpage;
+  f->inode = inode;
+  f->ofs = ofs;
+  f->read_bytes = read_bytes;
+  f->text = text;
+  f->ref_cnt = 1;
+  lock_init(&f->load_lock);
+  list_init(&f->pages);
+  f->pin_cnt = 1;
+  lock_acquire(&f->load_lock);
+  hash_insert(&shared_frames, &f->hash_elem);
+  frame_table_insert(f);
+  lock_release(&frame_lock);
+
+  /* Read the page without holding frame_lock, so that faults on
+     other frames can proceed in the meantime. */
+  n = inode_read_at(inode, f->kpage, read_bytes, ofs);
+  memset((uint8_t*)f->kpage + n, 0, PGSIZE - n);
+  lock_release(&f->load_lock);
+
+  return f;
+}
+
+/* Returns shared frame F, found in shared_frames, pinned and with
+   a new reference for the caller, once whoever is reading it in
+   or evicting it is done.  frame_lock must be held on entry and
+   is released. */
+static struct frame* frame_get_shared(struct frame* f) {
+  f->ref_cnt++;
+  f->pin_cnt++;
+  lock_release(&frame_lock);
+
+  /* Our reference keeps an evictor from freeing the frame, so
+     its contents are still good when we get it. */
+  lock_acquire(&f->load_lock);
+  lock_release(&f->load_lock);
+  return f;
+}
+
+/* Records that PAGE maps frame F, which makes F a candidate for
+   eviction once it is unpinned. */
+void frame_map(struct frame* f, struct page* page) {
+  lock_acquire(&frame_lock);
+  list_push_back(&f->pages, &page->frame_elem);
+  lock_release(&frame_lock);
+}
+
+/* Adds a reference to frame F, which the caller already holds a
+   reference to, for PAGE, another page that maps it. */
+void frame_share(struct frame* f, struct page* page) {
+  lock_acquire(&frame_lock);
+  ASSERT(f->ref_cnt > 0);
+  f->ref_cnt++;
+  list_push_back(&f->pages, &page->frame_elem);
+  lock_release(&frame_lock);
+}
+
+/* Returns true if more than one page maps frame F. */
+bool frame_is_shared(struct frame* f) {
+  bool shared;
+
+  lock_acquire(&frame_lock);
+  shared = f->ref_cnt > 1;
+  lock_release(&frame_lock);
+
+  return shared;
+}
+
+/* Drops PAGE's reference to frame F, freeing F once no page maps
+   it any longer. */
+void frame_unmap(struct frame* f, struct page* page) {
+  bool free_frame;
+
+  lock_acquire(&frame_lock);
+  ASSERT(f->ref_cnt > 0);
+  list_remove(&page->frame_elem);
+  free_frame = --f->ref_cnt == 0;
+  if (free_frame)
+    frame_table_remove(f);
+  lock_release(&frame_lock);
+
+  if (free_frame)
+    frame_free(f);
+}
+
+/* Gives back pinned frame F, obtained from frame_alloc() or
+   frame_get_file() but never mapped. */
+void frame_release(struct frame* f) {
+  bool free_frame;
+
+  lock_acquire(&frame_lock);
+  ASSERT(f->ref_cnt > 0 && f->pin_cnt > 0);
+  f->pin_cnt--;
+  free_frame = --f->ref_cnt == 0;
+  if (free_frame)
+    frame_table_remove(f);
+  lock_release(&frame_lock);
+
+  if (free_frame)
+    frame_free(f);
+}
+
+/* Keeps frame F from being evicted until a matching call to
+   frame_unpin(). */
+void frame_pin(struct frame* f) {
+  lock_acquire(&frame_lock);
+  f->pin_cnt++;
+  lock_release(&frame_lock);
+}
+
+/* Undoes one frame_pin() of frame F. */
+void frame_unpin(struct frame* f) {
+  lock_acquire(&frame_lock);
+  ASSERT(f->pin_cnt > 0);
+  f->pin_cnt--;
+  lock_release(&frame_lock);
+}
+
+/* Returns the frame in shared_frames that matches KEY, or a null
+   pointer if there is none.  frame_lock must be held. */
+static struct frame* frame_find(struct frame* key) {
+  struct hash_elem* e = hash_find(&shared_frames, &key->hash_elem);
+  return e != NULL ? hash_entry(e, struct frame, hash_elem) : NULL;
+}
+
+/* Adds F to the frame table, just behind the clock hand, so that
+   it is the last frame the hand reaches.  frame_lock must be
+   held. */
+static void frame_table_insert(struct frame* f) {
+  list_insert(clock_hand, &f->elem);
+}
+
+/* Removes F from the frame table and from shared_frames, if it is
+   there, so that it can no longer be found.  frame_lock must be
+   held. */
+static void frame_table_remove(struct frame* f) {
+  if (clock_hand == &f->elem)
+    clock_hand = list_next(clock_hand);
+  list_remove(&f->elem);
+  if (f->inode != NULL)
+    hash_delete(&shared_frames, &f->hash_elem);
+}
+
+/* Frees F and its page, after frame_table_remove(). */
+static void frame_free(struct frame* f) {
+  palloc_free_page(f->kpage);
+  free(f);
+}
+
+/* Returns a page from the user pool, evicting a frame to make
+   room if the pool is empty, or a null pointer if every frame is
+   pinned or cannot be written out. */
+static void* get_user_page(void) {
+  void* kpage = palloc_get_page(PAL_USER);
+  return kpage != NULL ? kpage : evict();
+}
+
+/* Evicts a frame chosen by the clock algorithm and returns its
+   page for reuse, or returns a null pointer if no frame can be
+   evicted.
+
+   The frame is unmapped from every page that maps it.  A frame
+   that is not backed by a file is written to swap, and each of
+   its pages remembers the slot; a frame of a memory-mapped file
+   is written back to the file if any of its pages modified it;
+   program text is simply dropped. */
+static void* evict(void) {
+  for (;;) {
+    struct frame* f;
+    struct list_elem* e;
+    size_t slot;
+    bool dirty = false;
+    void* kpage = NULL;
+
+    lock_acquire(&frame_lock);
+    f = choose_victim(&slot);
+    if (f == NULL) {
+      lock_release(&frame_lock);
+      return NULL;
+    }
+
+    /* Clearing the mappings first keeps the frame from changing
+       while it is written out.  The dirty bits survive in the
+       not-present PTEs. */
+    for (e = list_begin(&f->pages); e != list_end(&f->pages); e = list_next(e)) {
+      struct page* page = list_entry(e, struct page, frame_elem);
+      uint32_t* pd = page->process->pagedir;
+
+      pagedir_clear_page(pd, page->upage);
+      dirty |= pagedir_is_dirty(pd, page->upage);
+      page->frame = NULL;
+      page->cow = false;
+      page->swap_slot = slot;
+    }
+    lock_release(&frame_lock);
+
+    /* The owners' pages_locks keep them from faulting the frame
+       back in, and its load_lock keeps anyone who finds it in
+       shared_frames from mapping it, until we are done. */
+    if (f->inode == NULL)
+      swap_write(slot, f->kpage);
+    else if (dirty)
+      inode_write_at(f->inode, f->kpage, f->read_bytes, f->ofs);
+
+    lock_acquire(&frame_lock);
+    while (!list_empty(&f->pages)) {
+      struct page* page = list_entry(list_pop_front(&f->pages), struct page, frame_elem);
+
+      f->ref_cnt--;
+      if (page->evict_locked) {
+        page->evict_locked = false;
+        lock_release(&page->process->pages_lock);
+      }
+    }
+    f->pin_cnt--;
+    lock_release(&f->load_lock);
+    if (f->ref_cnt == 0) {
+      frame_table_remove(f);
+      kpage = f->kpage;
+    }
+    lock_release(&frame_lock);
+
+    if (kpage != NULL) {
+      free(f);
+      return kpage;
+    }
+
+    /* Someone faulted in the frame's data while it was being
+       written out, so they keep the frame.  Try another. */
+  }
+}
+
+/* Sweeps the clock hand over the frame table in search of a
+   frame to evict.  A frame whose pages have been accessed since
+   the hand last passed gets a second chance; pinned frames, and
+   frames of processes that are busy with their page tables, are
+   skipped.  Returns the frame, pinned, with its load_lock and the
+   pages_locks of all the processes that map it held, and stores
+   in *SLOT a swap slot reserved for it, or SWAP_ERROR if it is
+   backed by a file.  Returns a null pointer if two full sweeps
+   turn up nothing.  frame_lock must be held. */
+static struct frame* choose_victim(size_t* slot) {
+  size_t tries = 2 * list_size(&frame_table);
+
+  while (tries-- > 0) {
+    struct frame* f;
+
+    if (clock_hand == list_end(&frame_table))
+      clock_hand = list_begin(&frame_table);
+    f = list_entry(clock_hand, struct frame, elem);
+    clock_hand = list_next(clock_hand);
+
+    if (f->pin_cnt > 0 || list_empty(&f->pages) || !lock_owners(f))
+      continue;
+    if (test_and_clear_accessed(f)) {
+      unlock_owners(f);
+      continue;
+    }
+
+    *slot = SWAP_ERROR;
+    if (f->inode == NULL) {
+      *slot = swap_alloc(list_size(&f->pages));
+      if (*slot == SWAP_ERROR) {
+        unlock_owners(f);
+        continue;
+      }
+    }
+
+    f->pin_cnt++;
+    lock_acquire(&f->load_lock);
+    return f;
+  }
+  return NULL;
+}
+
+/* Acquires the pages_lock of every process with a page that maps
+   frame F, other than those the current thread already holds,
+   without waiting for any of them.  Waiting could deadlock, since
+   the process that holds a pages_lock may itself be evicting.
+   Returns true if successful, false if some lock was busy, in
+   which case none is left held.  frame_lock must be held. */
+static bool lock_owners(struct frame* f) {
+  struct list_elem* e;
+
+  for (e = list_begin(&f->pages); e != list_end(&f->pages); e = list_next(e)) {
+    struct page* page = list_entry(e, struct page, frame_elem);
+    struct lock* lock = &page->process->pages_lock;
+
+    if (lock_held_by_current_thread(lock))
+      continue;
+    if (!lock_try_acquire(lock)) {
+      unlock_owners(f);
+      return false;
+    }
+    page->evict_locked = true;
+  }
+  return true;
+}
+
+/* Releases the pages_locks that lock_owners() acquired for frame
+   F.  frame_lock must be held. */
+static void unlock_owners(struct frame* f) {
+  struct list_elem* e;
+
+  for (e = list_begin(&f->pages); e != list_end(&f->pages); e = list_next(e)) {
+    struct page* page = list_entry(e, struct page, frame_elem);
+
+    if (page->evict_locked) {
+      page->evict_locked = false;
+      lock_release(&page->process->pages_lock);
+    }
+  }
+}
+
+/* Returns true if any page that maps frame F has been accessed
+   since the last call, clearing their accessed bits.  The
+   pages_locks of their processes must be held. */
+static bool test_and_clear_accessed(struct frame* f) {
+  struct list_elem* e;
+  bool accessed = false;
+
+  for (e = list_begin(&f->pages); e != list_end(&f->pages); e = list_next(e)) {
+    struct page* page = list_entry(e, struct page, frame_elem);
+    uint32_t* pd = page->process->pagedir;
+
+    if (pagedir_is_accessed(pd, page->upage)) {
+      pagedir_set_accessed(pd, page->upage, false);
+      accessed = true;
+    }
+  }
+  return accessed;
+}
+
+/* Returns a hash value for frame E's inode and offset. */
+static unsigned frame_hash(const struct hash_elem* e, void* aux UNUSED) {
+  const struct frame* f = hash_entry(e, struct frame, hash_elem);
+  return hash_bytes(&f->inode, sizeof f->inode) ^ hash_int(f->ofs);
+}
+
+/* Returns true if frame A precedes frame B in (inode, offset,
+   read_bytes, text) order. */
+static bool frame_less(const struct hash_elem* a_, const struct hash_elem* b_, void* aux UNUSED) {
+  const struct frame* a = hash_entry(a_, struct frame, hash_elem);
+  const struct frame* b = hash_entry(b_, struct frame, hash_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  if (a->ofs != b->ofs)
+    return a->ofs < b->ofs;
+  if (a->read_bytes != b->read_bytes)
+    return a->read_bytes < b->read_bytes;
+  return a->text < b->text;
+}
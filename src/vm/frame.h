@@ -0,0 +1,63 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+struct inode;
+struct page;
+
+/* A physical frame holding a user page.
+
+   A frame that holds a shared page of a file is identified by
+   the file's inode, the page's offset within it, how many bytes
+   of the page come from the file, and whether it is read-only
+   program text or part of a memory-mapped file.  Every process
+   that maps the same page in the same way shares the frame,
+   which is freed once the last of them lets go of it.  Other
+   frames have a null INODE and belong to a single page, except
+   that fork() lets parent and child share them copy-on-write.
+
+   Text and mmap frames are kept apart because the last page of
+   a text segment is zero-padded rather than holding whatever
+   follows it in the file, and because an mmap page may be
+   written while text must not change under a running
+   program.
+
+   Every frame is on the frame table, which the clock algorithm
+   sweeps to find a frame to evict when the user pool runs dry.
+   A pinned frame is never evicted; frames are pinned while the
+   kernel fills them, copies them, or accesses them on behalf of
+   a system call. */
+struct frame {
+  void* kpage; /* Kernel virtual address of the frame. */
+
+  struct inode* inode;        /* Inode whose contents the frame holds. */
+  off_t ofs;                  /* Offset of the frame's data in INODE. */
+  size_t read_bytes;          /* Bytes read from INODE; the rest are zero. */
+  bool text;                  /* True for read-only program text. */
+  int ref_cnt;                /* Number of pages mapping the frame. */
+  struct lock load_lock;      /* Held while the frame is read in or evicted. */
+  struct hash_elem hash_elem; /* Element in the shared frame table. */
+
+  struct list pages;     /* Pages that map the frame (struct page frame_elem). */
+  int pin_cnt;           /* Frame may be evicted only when 0. */
+  struct list_elem elem; /* Element in the frame table. */
+};
+
+void frame_init(void);
+struct frame* frame_alloc(void);
+struct frame* frame_get_file(struct inode*, off_t ofs, size_t read_bytes, bool text);
+void frame_map(struct frame*, struct page*);
+void frame_share(struct frame*, struct page*);
+bool frame_is_shared(struct frame*);
+void frame_unmap(struct frame*, struct page*);
+void frame_release(struct frame*);
+void frame_pin(struct frame*);
+void frame_unpin(struct frame*);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,184 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/page.h"
+
+/* A memory-mapped file.
+
+   Each mapping keeps its own reopened handle on the file, so the
+   mapping outlives the file descriptor it was created from and
+   even the removal of the file.  The pages themselves live in
+   the supplemental page table and are read in on demand. */
+struct mapping {
+  mapid_t id;            /* Mapping identifier. */
+  struct file* file;     /* File being mapped. */
+  uint8_t* base;         /* User virtual address of the first page. */
+  size_t page_cnt;       /* Number of pages mapped. */
+  struct list_elem elem; /* Element in the process's mappings list. */
+};
+
+static void unmap(struct mapping*, struct pagedir_batch*);
+
+/* Maps FILE into the current process's address space starting at
+   user virtual address ADDR.  Pages are read from the file when
+   first accessed, and modified pages are written back to it when
+   the mapping is removed.  Returns the new mapping's identifier,
+   or MAP_FAILED if FILE is empty, ADDR is null or not
+   page-aligned, or the mapping would overlap pages that are
+   already in use. */
+mapid_t mmap_map(struct file* file, void* addr) {
+  struct process* p = thread_current()->pcb;
+  struct mapping* m;
+  off_t length;
+  size_t i;
+
+  if (addr == NULL || pg_ofs(addr) != 0 || !is_user_vaddr(addr))
+    return MAP_FAILED;
+
+  m = malloc(sizeof *m);
+  if (m == NULL)
+    return MAP_FAILED;
+  m->file = file_reopen(file);
+  if (m->file == NULL) {
+    free(m);
+    return MAP_FAILED;
+  }
+  m->base = addr;
+  length = file_length(m->file);
+  m->page_cnt = DIV_ROUND_UP(length, PGSIZE);
+
+  /* The whole mapping must fit in user memory. */
+  if (length == 0 || (uintptr_t)PHYS_BASE - (uintptr_t)addr < m->page_cnt * PGSIZE) {
+    file_close(m->file);
+    free(m);
+    return MAP_FAILED;
+  }
+
+  lock_acquire(&p->pages_lock);
+  for (i = 0; i < m->page_cnt; i++) {
+    uint8_t* upage = m->base + i * PGSIZE;
+    off_t ofs = i * PGSIZE;
+    size_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+    /* Pages loaded outside the supplemental page table, such as
+       the stack, are only visible in the page directory. */
+    if (pagedir_get_page(p->pagedir, upage) != NULL ||
+        page_add_file(upage, m->file, ofs, read_bytes, true) == NULL) {
+      struct pagedir_batch batch;
+
+      /* None of the pages has been mapped yet, so there is
+         nothing to invalidate. */
+      pagedir_batch_init(&batch, p->pagedir);
+      m->page_cnt = i;
+      unmap(m, &batch);
+      lock_release(&p->pages_lock);
+      return MAP_FAILED;
+    }
+  }
+  m->id = p->next_mapid++;
+  list_push_back(&p->mappings, &m->elem);
+  lock_release(&p->pages_lock);
+
+  return m->id;
+}
+
+/* Removes the current process's mapping with identifier ID,
+   writing modified pages back to the file.  Returns false if
+   there is no such mapping. */
+bool mmap_unmap(mapid_t id) {
+  struct process* p = thread_current()->pcb;
+  struct list_elem* e;
+
+  lock_acquire(&p->pages_lock);
+  for (e = list_begin(&p->mappings); e != list_end(&p->mappings); e = list_next(e)) {
+    struct mapping* m = list_entry(e, struct mapping, elem);
+
+    if (m->id == id) {
+      struct pagedir_batch batch;
+
+      list_remove(e);
+      pagedir_batch_init(&batch, p->pagedir);
+      unmap(m, &batch);
+      pagedir_batch_finish(&batch);
+      lock_release(&p->pages_lock);
+      return true;
+    }
+  }
+  lock_release(&p->pages_lock);
+
+  return false;
+}
+
+/* Removes all of the current process's mappings.  Called on exit,
+   before the page directory is destroyed. */
+void mmap_unmap_all(void) {
+  struct process* p = thread_current()->pcb;
+  struct pagedir_batch batch;
+
+  lock_acquire(&p->pages_lock);
+  pagedir_batch_init(&batch, p->pagedir);
+  while (!list_empty(&p->mappings))
+    unmap(list_entry(list_pop_front(&p->mappings), struct mapping, elem), &batch);
+  pagedir_batch_finish(&batch);
+  lock_release(&p->pages_lock);
+}
+
+/* Copies PARENT's mappings into the current process for fork().
+   The child gets its own handle on each mapped file but shares
+   the frames of the pages the parent has already read in, so
+   both processes see each other's writes, as with any other
+   processes mapping the same file.  The pages_locks of both
+   processes must be held.  Returns true if successful.  On
+   failure, the mappings copied so far are left for
+   mmap_unmap_all() to remove. */
+bool mmap_fork(struct process* parent) {
+  struct process* p = thread_current()->pcb;
+  struct list_elem* e;
+
+  for (e = list_begin(&parent->mappings); e != list_end(&parent->mappings); e = list_next(e)) {
+    struct mapping* pm = list_entry(e, struct mapping, elem);
+    struct mapping* m;
+
+    m = malloc(sizeof *m);
+    if (m == NULL)
+      return false;
+    m->file = file_reopen(pm->file);
+    if (m->file == NULL) {
+      free(m);
+      return false;
+    }
+    m->id = pm->id;
+    m->base = pm->base;
+    m->page_cnt = 0;
+    list_push_back(&p->mappings, &m->elem);
+
+    while (m->page_cnt < pm->page_cnt) {
+      if (!page_fork_file(parent, m->base + m->page_cnt * PGSIZE, m->file))
+        return false;
+      m->page_cnt++;
+    }
+  }
+  p->next_mapid = parent->next_mapid;
+  return true;
+}
+
+/* Removes M's pages from the supplemental page table, clearing
+   their mappings as part of BATCH, closes its file and frees it.
+   M must not be in the mappings list. */
+static void unmap(struct mapping* m, struct pagedir_batch* batch) {
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++)
+    page_remove(page_lookup(m->base + i * PGSIZE), batch);
+  file_close(m->file);
+  free(m);
+}
@@ -0,0 +1,18 @@
+#ifndef VM_MMAP_H
+#define VM_MMAP_H
+
+#include <stdbool.h>
+
+/* Map region identifier. */
+typedef int mapid_t;
+#define MAP_FAILED ((mapid_t)-1)
+
+struct file;
+struct process;
+
+mapid_t mmap_map(struct file*, void* addr);
+bool mmap_unmap(mapid_t);
+void mmap_unmap_all(void);
+bool mmap_fork(struct process* parent);
+
+#endif /* vm/mmap.h */
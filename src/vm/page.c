@@ -0,0 +1,514 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+/* Supplemental page tables.
+
+   Each process keeps a hash table of the pages it may access,
+   keyed by user virtual address, in its PCB.  The table is
+   protected by the process's pages_lock: page_lookup(), the
+   page_add_*() functions and page_remove() must be called with
+   it held, while the other functions here acquire it
+   themselves. */
+
+/* Default limit on the size of a process's stack, in pages.
+   Settable with the kernel's -ustack option. */
+size_t stack_page_limit = MAX_STACK_PAGES;
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_destroy;
+static struct page* page_create(void* upage, enum page_type, bool writable);
+static struct page* page_lookup_in(struct process*, const void* upage);
+static bool is_stack_access(struct process*, const void* fault_addr, const void* esp);
+static bool page_in(struct page*);
+static bool page_unshare(struct page*);
+static void page_out(struct page*, struct pagedir_batch*);
+static bool page_fork(struct process* parent, struct page* ppage, struct file* file);
+
+/* Initializes the current process's supplemental page table. */
+void page_table_init(void) {
+  struct process* p = thread_current()->pcb;
+
+  hash_init(&p->pages, page_hash, page_less, NULL);
+  lock_init(&p->pages_lock);
+  p->stack_limit = stack_page_limit;
+}
+
+/* Removes every page from the current process's supplemental
+   page table, writing back modified file pages, and frees the
+   table.  Must be called before the process's page directory is
+   destroyed.  The TLB is brought up to date once at the end,
+   rather than once per page. */
+void page_table_destroy(void) {
+  struct process* p = thread_current()->pcb;
+  struct pagedir_batch batch;
+
+  lock_acquire(&p->pages_lock);
+  pagedir_batch_init(&batch, p->pagedir);
+
+  /* hash_destroy() passes the table's auxiliary data on to
+     page_destroy(). */
+  p->pages.aux = &batch;
+  hash_destroy(&p->pages, page_destroy);
+  pagedir_batch_finish(&batch);
+  lock_release(&p->pages_lock);
+}
+
+/* Returns the current process's page that contains user virtual
+   address UPAGE, or a null pointer if there is none. */
+struct page* page_lookup(const void* upage) {
+  return page_lookup_in(thread_current()->pcb, upage);
+}
+
+/* Returns process P's page that contains user virtual address
+   UPAGE, or a null pointer if there is none.  P's pages_lock
+   must be held. */
+static struct page* page_lookup_in(struct process* p, const void* upage) {
+  struct page key;
+  struct hash_elem* e;
+
+  ASSERT(lock_held_by_current_thread(&p->pages_lock));
+
+  key.upage = pg_round_down(upage);
+  e = hash_find(&p->pages, &key.hash_elem);
+  return e != NULL ? hash_entry(e, struct page, hash_elem) : NULL;
+}
+
+/* Adds a page of type TYPE at user virtual address UPAGE to the
+   current process's supplemental page table.  Returns the new
+   page, with its file members still to be filled in, or a null
+   pointer if UPAGE is already in use or memory is exhausted. */
+static struct page* page_create(void* upage, enum page_type type, bool writable) {
+  struct process* p = thread_current()->pcb;
+  struct page* page;
+
+  ASSERT(lock_held_by_current_thread(&p->pages_lock));
+  ASSERT(pg_ofs(upage) == 0);
+  ASSERT(is_user_vaddr(upage));
+
+  page = malloc(sizeof *page);
+  if (page == NULL)
+    return NULL;
+
+  page->upage = upage;
+  page->process = p;
+  page->type = type;
+  page->writable = writable;
+  page->frame = NULL;
+  page->cow = false;
+  page->swap_slot = SWAP_ERROR;
+  page->evict_locked = false;
+  page->file = NULL;
+  page->file_ofs = 0;
+  page->read_bytes = 0;
+
+  if (hash_insert(&p->pages, &page->hash_elem) != NULL) {
+    free(page);
+    return NULL;
+  }
+  return page;
+}
+
+/* Adds a page at user virtual address UPAGE to the current
+   process's supplemental page table, to be filled on demand with
+   READ_BYTES bytes of FILE starting at offset OFS followed by
+   zeros.  Modifications to the page are written back to FILE.
+   Returns the new page, or a null pointer if UPAGE is already in
+   use or memory is exhausted. */
+struct page* page_add_file(void* upage, struct file* file, off_t ofs, size_t read_bytes,
+                           bool writable) {
+  struct page* page;
+
+  ASSERT(read_bytes <= PGSIZE);
+
+  page = page_create(upage, PAGE_FILE, writable);
+  if (page != NULL) {
+    page->file = file;
+    page->file_ofs = ofs;
+    page->read_bytes = read_bytes;
+  }
+  return page;
+}
+
+/* Like page_add_file(), but for a page of an executable's
+   segment: modifications stay private to the process and are
+   never written back to FILE. */
+struct page* page_add_exec(void* upage, struct file* file, off_t ofs, size_t read_bytes,
+                           bool writable) {
+  struct page* page;
+
+  ASSERT(read_bytes <= PGSIZE);
+
+  page = page_create(upage, PAGE_EXEC, writable);
+  if (page != NULL) {
+    page->file = file;
+    page->file_ofs = ofs;
+    page->read_bytes = read_bytes;
+  }
+  return page;
+}
+
+/* Adds a page at user virtual address UPAGE to the current
+   process's supplemental page table that reads as zeros until
+   it is written.  No memory is allocated for it until then.
+   Returns the new page, or a null pointer if UPAGE is already in
+   use or memory is exhausted. */
+struct page* page_add_zero(void* upage, bool writable) {
+  return page_create(upage, PAGE_ZERO, writable);
+}
+
+/* Removes PAGE from the current process's supplemental page
+   table and frees it, first writing it back to its file if it
+   is present and has been modified.  Its mapping is cleared as
+   part of BATCH, which the caller must finish before returning
+   to user mode. */
+void page_remove(struct page* page, struct pagedir_batch* batch) {
+  struct process* p = thread_current()->pcb;
+
+  ASSERT(lock_held_by_current_thread(&p->pages_lock));
+
+  hash_delete(&p->pages, &page->hash_elem);
+  page_destroy(&page->hash_elem, batch);
+}
+
+/* Handles a page fault at FAULT_ADDR in the current process.
+   NOT_PRESENT and WRITE describe the fault as page_fault() found
+   it, and ESP is the process's user stack pointer.  A fault on a
+   not-present page brings in the page, if the process has one
+   there, or adds a new zeroed page if the access is just below
+   the stack; a write to a copy-on-write page gives the process
+   its own copy.  Returns true if the faulting access can now be
+   retried, false if it is a genuine bad access. */
+bool page_handle_fault(const void* fault_addr, bool not_present, bool write, const void* esp) {
+  struct process* p = thread_current()->pcb;
+  struct page* page;
+  bool success;
+
+  if (p == NULL || !is_user_vaddr(fault_addr))
+    return false;
+
+  lock_acquire(&p->pages_lock);
+  page = page_lookup(fault_addr);
+  if (page == NULL && not_present && is_stack_access(p, fault_addr, esp))
+    page = page_add_zero(pg_round_down(fault_addr), true);
+  if (page == NULL)
+    success = false;
+  else if (not_present)
+    success = page->frame != NULL || page_in(page);
+  else
+    success = write && page->cow && page_unshare(page);
+  lock_release(&p->pages_lock);
+
+  return success;
+}
+
+/* Returns true if FAULT_ADDR, which the process has no page for,
+   looks like process P growing its stack, whose pointer is ESP.
+   The address must be within P's stack limit of the top of user
+   memory, and no further below ESP than the 32 bytes that PUSHA
+   writes before it moves ESP. */
+static bool is_stack_access(struct process* p, const void* fault_addr, const void* esp) {
+  uintptr_t addr = (uintptr_t)fault_addr;
+
+  return ((uintptr_t)PHYS_BASE - addr) / PGSIZE < p->stack_limit && addr + 32 >= (uintptr_t)esp;
+}
+
+/* Brings in the pages of the current process that span the SIZE
+   bytes at user virtual address UADDR, and pins their frames so
+   that the kernel can access them without page faulting.  A
+   system call must do this before handing a user buffer to code
+   that holds locks a page fault may need, such as the file
+   system's.  If WRITE is true, the pages must be writable, and
+   copy-on-write pages get copies of their own.  Returns true if
+   successful, false if some page is not one the process may
+   access that way, in which case nothing is left pinned. */
+bool page_pin(const void* uaddr, size_t size, bool write) {
+  struct process* p = thread_current()->pcb;
+  uint8_t* start = pg_round_down(uaddr);
+  const uint8_t* end = (const uint8_t*)uaddr + size;
+  uint8_t* upage;
+
+  if (size == 0)
+    return true;
+
+  lock_acquire(&p->pages_lock);
+  for (upage = start; upage < end; upage += PGSIZE) {
+    struct page* page = page_lookup(upage);
+
+    if (page == NULL || (write && !page->writable) || (page->frame == NULL && !page_in(page)) ||
+        (write && page->cow && !page_unshare(page))) {
+      lock_release(&p->pages_lock);
+      if (upage > start)
+        page_unpin(start, upage - start);
+      return false;
+    }
+    frame_pin(page->frame);
+  }
+  lock_release(&p->pages_lock);
+
+  return true;
+}
+
+/* Unpins the frames that page_pin() pinned for the SIZE bytes at
+   user virtual address UADDR. */
+void page_unpin(const void* uaddr, size_t size) {
+  struct process* p = thread_current()->pcb;
+  uint8_t* upage;
+  const uint8_t* end = (const uint8_t*)uaddr + size;
+
+  lock_acquire(&p->pages_lock);
+  for (upage = pg_round_down(uaddr); upage < end; upage += PGSIZE) {
+    struct page* page = page_lookup(upage);
+
+    if (page != NULL && page->frame != NULL)
+      frame_unpin(page->frame);
+  }
+  lock_release(&p->pages_lock);
+}
+
+/* Brings PAGE into a frame and maps it in the current process's
+   page directory.  Returns true if successful. */
+static bool page_in(struct page* page) {
+  struct frame* f;
+
+  ASSERT(page->frame == NULL);
+
+  /* A page that was evicted to swap comes back from there,
+     whatever its type.  It no longer shares its frame with
+     anyone. */
+  if (page->swap_slot != SWAP_ERROR) {
+    f = frame_alloc();
+    if (f == NULL)
+      return false;
+    swap_read(page->swap_slot, f->kpage);
+    swap_free(page->swap_slot);
+    page->swap_slot = SWAP_ERROR;
+    goto map;
+  }
+
+  switch (page->type) {
+    case PAGE_FILE:
+      f = frame_get_file(file_get_inode(page->file), page->file_ofs, page->read_bytes, false);
+      if (f == NULL)
+        return false;
+      break;
+
+    case PAGE_EXEC:
+      /* Read-only text is the same in every process running the
+         program, so share it. */
+      if (!page->writable) {
+        f = frame_get_file(file_get_inode(page->file), page->file_ofs, page->read_bytes, true);
+        if (f == NULL)
+          return false;
+        break;
+      }
+
+      f = frame_alloc();
+      if (f == NULL)
+        return false;
+      if (file_read_at(page->file, f->kpage, page->read_bytes, page->file_ofs) !=
+          (off_t)page->read_bytes) {
+        frame_release(f);
+        return false;
+      }
+      memset((uint8_t*)f->kpage + page->read_bytes, 0, PGSIZE - page->read_bytes);
+      break;
+
+    case PAGE_ZERO:
+      f = frame_alloc();
+      if (f == NULL)
+        return false;
+      memset(f->kpage, 0, PGSIZE);
+      break;
+
+    default:
+      NOT_REACHED();
+  }
+
+map:
+  if (!pagedir_set_page(thread_current()->pcb->pagedir, page->upage, f->kpage, page->writable)) {
+    frame_release(f);
+    return false;
+  }
+  frame_map(f, page);
+  frame_unpin(f);
+  page->frame = f;
+  return true;
+}
+
+/* Gives copy-on-write PAGE a frame of its own, copying the
+   shared one unless every other sharer has let go of it in the
+   meantime, and maps it writable.  Returns true if successful. */
+static bool page_unshare(struct page* page) {
+  uint32_t* pd = thread_current()->pcb->pagedir;
+  struct frame* old = page->frame;
+  struct frame* new = old;
+
+  ASSERT(page->cow && page->writable);
+
+  /* Nobody can start sharing the frame while we hold our
+     pages_lock, so if it is ours alone it stays that way.  The
+     frame we copy from must not be evicted to make room for the
+     copy. */
+  if (frame_is_shared(old)) {
+    frame_pin(old);
+    new = frame_alloc();
+    if (new != NULL)
+      memcpy(new->kpage, old->kpage, PGSIZE);
+    frame_unpin(old);
+    if (new == NULL)
+      return false;
+  }
+
+  pagedir_clear_page(pd, page->upage);
+  if (!pagedir_set_page(pd, page->upage, new->kpage, true))
+    NOT_REACHED();
+  if (new != old) {
+    frame_unmap(old, page);
+    frame_map(new, page);
+    frame_unpin(new);
+  }
+
+  page->frame = new;
+  page->cow = false;
+  return true;
+}
+
+/* Copies the supplemental page table of PARENT into the current
+   process for fork(), except for the pages of memory-mapped
+   files, which page_fork_file() copies.  Pages of the executable
+   read from EXEC_FILE, the child's own handle on it.  Resident
+   pages are mapped into the child's page directory without being
+   copied: read-only pages are simply shared, and private
+   writable ones become copy-on-write in both processes.  The
+   pages_locks of both processes must be held.  Returns true if
+   successful. */
+bool page_table_fork(struct process* parent, struct file* exec_file) {
+  struct hash_iterator i;
+
+  ASSERT(lock_held_by_current_thread(&parent->pages_lock));
+
+  thread_current()->pcb->stack_limit = parent->stack_limit;
+  hash_first(&i, &parent->pages);
+  while (hash_next(&i)) {
+    struct page* ppage = hash_entry(hash_cur(&i), struct page, hash_elem);
+
+    if (ppage->type != PAGE_FILE && !page_fork(parent, ppage, exec_file))
+      return false;
+  }
+  return true;
+}
+
+/* Copies PARENT's page at UPAGE, a page of a memory-mapped file,
+   into the current process for fork().  The child's page reads
+   and writes back through FILE and shares the parent's frame, if
+   any, so that writes by either process are seen by both.  The
+   pages_locks of both processes must be held.  Returns true if
+   successful. */
+bool page_fork_file(struct process* parent, void* upage, struct file* file) {
+  struct page* ppage = page_lookup_in(parent, upage);
+
+  ASSERT(ppage != NULL && ppage->type == PAGE_FILE);
+  return page_fork(parent, ppage, file);
+}
+
+/* Adds a copy of PARENT's page PPAGE to the current process,
+   reading from FILE instead of PPAGE's file.  See
+   page_table_fork(). */
+static bool page_fork(struct process* parent, struct page* ppage, struct file* file) {
+  struct page* page;
+  struct frame* f = ppage->frame;
+  bool cow;
+
+  page = page_create(ppage->upage, ppage->type, ppage->writable);
+  if (page == NULL)
+    return false;
+  if (ppage->file != NULL)
+    page->file = file;
+  page->file_ofs = ppage->file_ofs;
+  page->read_bytes = ppage->read_bytes;
+
+  /* A page in swap shares its slot until either process faults
+     it back in. */
+  if (f == NULL) {
+    if (ppage->swap_slot != SWAP_ERROR) {
+      swap_share(ppage->swap_slot);
+      page->swap_slot = ppage->swap_slot;
+    }
+    return true;
+  }
+
+  /* Private writable frames become copy-on-write.  Shared frames
+     of memory-mapped files stay writable by everyone. */
+  cow = ppage->writable && f->inode == NULL;
+  if (cow && !ppage->cow) {
+    pagedir_clear_page(parent->pagedir, ppage->upage);
+    if (!pagedir_set_page(parent->pagedir, ppage->upage, f->kpage, false))
+      NOT_REACHED();
+    ppage->cow = true;
+  }
+
+  if (!pagedir_set_page(thread_current()->pcb->pagedir, page->upage, f->kpage,
+                        page->writable && !cow))
+    return false;
+  frame_share(f, page);
+  page->frame = f;
+  page->cow = cow;
+  return true;
+}
+
+/* Unmaps PAGE from the current process's page directory as part
+   of BATCH and lets go of its frame, writing its contents back to
+   its file first if this process modified it. */
+static void page_out(struct page* page, struct pagedir_batch* batch) {
+  uint32_t* pd = thread_current()->pcb->pagedir;
+
+  ASSERT(page->frame != NULL);
+
+  /* Clearing the mapping first keeps other threads in the
+     process from changing the page while it is written back.
+     The dirty bit survives in the not-present PTE. */
+  pagedir_batch_clear_page(batch, page->upage);
+  if (page->type == PAGE_FILE && pagedir_is_dirty(pd, page->upage))
+    file_write_at(page->file, page->frame->kpage, page->read_bytes, page->file_ofs);
+
+  frame_unmap(page->frame, page);
+  page->frame = NULL;
+  page->cow = false;
+}
+
+/* Releases the page containing hash element E, clearing its
+   mapping as part of AUX, a struct pagedir_batch. */
+static void page_destroy(struct hash_elem* e, void* aux) {
+  struct page* page = hash_entry(e, struct page, hash_elem);
+
+  if (page->frame != NULL)
+    page_out(page, aux);
+  else if (page->swap_slot != SWAP_ERROR)
+    swap_free(page->swap_slot);
+  free(page);
+}
+
+/* Returns a hash value for the page containing hash element E. */
+static unsigned page_hash(const struct hash_elem* e, void* aux UNUSED) {
+  const struct page* page = hash_entry(e, struct page, hash_elem);
+  return hash_bytes(&page->upage, sizeof page->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool page_less(const struct hash_elem* a_, const struct hash_elem* b_, void* aux UNUSED) {
+  const struct page* a = hash_entry(a_, struct page, hash_elem);
+  const struct page* b = hash_entry(b_, struct page, hash_elem);
+
+  return a->upage < b->upage;
+}
@@ -0,0 +1,66 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct process;
+struct pagedir_batch;
+
+/* Where a page's contents come from. */
+enum page_type {
+  PAGE_FILE, /* Memory-mapped file; changes are written back to it. */
+  PAGE_EXEC, /* Executable segment; read from the file, never written back. */
+  PAGE_ZERO, /* Anonymous memory that starts out zeroed. */
+};
+
+/* An entry in a process's supplemental page table.
+
+   The page table proper only records the pages that are present
+   in memory.  The supplemental page table records every page the
+   process may access, along with where to find its contents the
+   next time it faults in, which is the swap slot it was evicted
+   to if it has one. */
+struct page {
+  void* upage;             /* User virtual address. */
+  struct process* process; /* Process whose address space holds the page. */
+  enum page_type type;     /* Source of the page's contents. */
+  bool writable;           /* True if the user may write the page. */
+  struct frame* frame;     /* Frame holding the page, or null if not present. */
+  bool cow;                /* Mapped read-only until written, as the frame is shared. */
+  size_t swap_slot;        /* Swap slot holding the page, or SWAP_ERROR. */
+
+  /* Backing file, for PAGE_FILE and PAGE_EXEC. */
+  struct file* file; /* File to read from. */
+  off_t file_ofs;    /* Offset of the page within FILE. */
+  size_t read_bytes; /* Bytes of FILE in the page; the rest are zero. */
+
+  struct hash_elem hash_elem;  /* Element in the supplemental page table. */
+  struct list_elem frame_elem; /* Element in the frame's list of pages. */
+  bool evict_locked;           /* Evictor took PROCESS's pages_lock for it. */
+};
+
+/* Default limit on the size of a process's stack, in pages. */
+extern size_t stack_page_limit;
+
+void page_table_init(void);
+void page_table_destroy(void);
+
+struct page* page_lookup(const void* upage);
+struct page* page_add_file(void* upage, struct file*, off_t ofs, size_t read_bytes, bool writable);
+struct page* page_add_exec(void* upage, struct file*, off_t ofs, size_t read_bytes, bool writable);
+struct page* page_add_zero(void* upage, bool writable);
+void page_remove(struct page*, struct pagedir_batch*);
+
+bool page_handle_fault(const void* fault_addr, bool not_present, bool write, const void* esp);
+bool page_pin(const void* uaddr, size_t size, bool write);
+void page_unpin(const void* uaddr, size_t size);
+
+bool page_table_fork(struct process* parent, struct file* exec_file);
+bool page_fork_file(struct process* parent, void* upage, struct file*);
+
+#endif /* vm/page.h */
@@ -0,0 +1,106 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Swap partition.
+
+   The swap partition is divided into page-sized slots.  A page
+   evicted from memory is written to a free slot and read back
+   from it the next time it faults in.  Pages that fork() left
+   sharing a frame copy-on-write also share its slot, so each
+   slot is reference counted and freed when the last page
+   holding it lets go. */
+
+/* Number of sectors per swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Swap device, or a null pointer if there is none. */
+static struct block* swap_device;
+
+/* Slots in use, and the number of pages holding each one. */
+static struct bitmap* used_slots;
+static unsigned short* slot_refs;
+
+/* Protects used_slots and slot_refs. */
+static struct lock swap_lock;
+
+/* Sets up swapping to the block device in the BLOCK_SWAP role, if
+   there is one.  Without it, pages that are not backed by a file
+   can never be evicted. */
+void swap_init(void) {
+  size_t slot_cnt;
+
+  lock_init_named(&swap_lock, "swap_lock");
+  swap_device = block_get_role(BLOCK_SWAP);
+  if (swap_device == NULL)
+    return;
+
+  slot_cnt = block_size(swap_device) / SECTORS_PER_SLOT;
+  used_slots = bitmap_create(slot_cnt);
+  slot_refs = calloc(slot_cnt, sizeof *slot_refs);
+  if (used_slots == NULL || slot_refs == NULL)
+    PANIC("swap: not enough memory for %zu slots", slot_cnt);
+}
+
+/* Reserves a free swap slot for a page held by REF_CNT pages and
+   returns it, or SWAP_ERROR if there is no swap device or it is
+   full. */
+size_t swap_alloc(unsigned ref_cnt) {
+  size_t slot;
+
+  ASSERT(ref_cnt > 0);
+
+  if (swap_device == NULL)
+    return SWAP_ERROR;
+
+  lock_acquire(&swap_lock);
+  slot = bitmap_scan_and_flip(used_slots, 0, 1, false);
+  if (slot != BITMAP_ERROR)
+    slot_refs[slot] = ref_cnt;
+  else
+    slot = SWAP_ERROR;
+  lock_release(&swap_lock);
+
+  return slot;
+}
+
+/* Writes the page at KPAGE to swap slot SLOT. */
+void swap_write(size_t slot, const void* kpage) {
+  size_t i;
+
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_write(swap_device, slot * SECTORS_PER_SLOT + i,
+                (const uint8_t*)kpage + i * BLOCK_SECTOR_SIZE);
+}
+
+/* Reads the page in swap slot SLOT into KPAGE. */
+void swap_read(size_t slot, void* kpage) {
+  size_t i;
+
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_read(swap_device, slot * SECTORS_PER_SLOT + i, (uint8_t*)kpage + i * BLOCK_SECTOR_SIZE);
+}
+
+/* Adds a reference to swap slot SLOT for another page that holds
+   it. */
+void swap_share(size_t slot) {
+  lock_acquire(&swap_lock);
+  ASSERT(bitmap_test(used_slots, slot));
+  slot_refs[slot]++;
+  lock_release(&swap_lock);
+}
+
+/* Drops a reference to swap slot SLOT, making it free once no
+   page holds it any longer. */
+void swap_free(size_t slot) {
+  lock_acquire(&swap_lock);
+  ASSERT(bitmap_test(used_slots, slot));
+  ASSERT(slot_refs[slot] > 0);
+  if (--slot_refs[slot] == 0)
+    bitmap_reset(used_slots, slot);
+  lock_release(&swap_lock);
+}
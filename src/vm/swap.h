@@ -0,0 +1,17 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A slot in the swap partition big enough to hold one page. */
+#define SWAP_ERROR SIZE_MAX
+
+void swap_init(void);
+size_t swap_alloc(unsigned ref_cnt);
+void swap_write(size_t slot, const void* kpage);
+void swap_read(size_t slot, void* kpage);
+void swap_share(size_t slot);
+void swap_free(size_t slot);
+
+#endif /* vm/swap.h */